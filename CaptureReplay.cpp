@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+#include "Graphics/FrameCapture.h"
+
+using namespace graphics;
+
+// Replays a capture saved by Device::CaptureNextFrame and reports how long the frame takes:
+//
+//     CaptureReplay <capture file> [--iterations N] [--null] [--trace trace.json]
+//
+// On the GL device every iteration ends with glFinish, so times include the GPU. --null replays on the null device,
+// which needs no window and measures the CPU side alone. --trace writes the profiled iterations as a Chrome trace.
+
+static void PrintUsage()
+{
+	std::cout << "Usage: CaptureReplay <capture file> [--iterations N] [--null] [--trace trace.json]" << std::endl;
+}
+
+static GLFWwindow* CreateHiddenWindow()
+{
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(1280, 720, "CaptureReplay", nullptr, nullptr);
+	if (window == nullptr)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return nullptr;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return nullptr;
+	}
+	return window;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+	std::string capture_path = argv[1];
+	std::string trace_path;
+	uint32_t iterations = 100;
+	bool null_device = false;
+	for (int i = 2; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) { iterations = std::max(1, std::atoi(argv[++i])); }
+		else if (std::strcmp(argv[i], "--null") == 0) { null_device = true; }
+		else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) { trace_path = argv[++i]; }
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	GLFWwindow* window = nullptr;
+	if (!null_device && (window = CreateHiddenWindow()) == nullptr) { return 1; }
+
+	int result = 0;
+	try
+	{
+		FrameCapture capture;
+		capture.Load(capture_path);
+		std::cout << capture_path << ": " << capture.GetCommandCount() << " commands, " << capture.pipelines_.size() << " pipelines, "
+			<< capture.resource_lists_.size() << " resource lists, " << capture.buffers_.size() << " buffers, " << capture.textures_.size()
+			<< " textures" << std::endl;
+
+		Device device(null_device
+		              ? DeviceBackend::kNull
+		              : DeviceBackend::kOpenGL);
+		capture.CreateResources(device);
+
+		// The first replay warms up shader compilation and driver caches and is not measured.
+		capture.Replay(device);
+		if (!null_device) { glFinish(); }
+
+		device.profiler_.SetEnabled(!trace_path.empty());
+		std::vector<double> times(iterations);
+		for (double& time : times)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			capture.Replay(device);
+			if (!null_device) { glFinish(); }
+			time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		std::sort(times.begin(), times.end());
+		double total = 0.0;
+		for (const double time : times) { total += time; }
+		std::cout << (null_device ? "Null" : "OpenGL") << " device, " << iterations << " iterations" << std::endl;
+		std::cout << "min " << times.front() << " ms, median " << times[times.size() / 2] << " ms, mean " << total / times.size()
+			<< " ms, p95 " << times[std::min(times.size() - 1, times.size() * 95 / 100)] << " ms, max " << times.back() << " ms" << std::endl;
+		if (null_device)
+		{
+			const Device::NullStats& stats = device.GetNullStats();
+			std::cout << stats.draws_ << " draws, " << stats.dispatches_ << " dispatches, " << stats.state_changes_ << " state changes, "
+				<< stats.invalid_handles_ << " invalid handles per frame" << std::endl;
+		}
+
+		if (!trace_path.empty())
+		{
+			// GPU passes of the last iterations are only read back once later frames retire them.
+			for (uint32_t i = 0; i < FrameProfiler::kFrameLatency; ++i) { device.profiler_.EndFrame(); }
+			device.profiler_.WriteChromeTrace(trace_path);
+			std::cout << "Trace written to " << trace_path << std::endl;
+		}
+		capture.DestroyResources(device);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		result = 1;
+	}
+
+	if (window != nullptr)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+	return result;
+}
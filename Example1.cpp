@@ -6,6 +6,7 @@
 #include "GLFW/glfw3.h"
 #include "gtc/type_ptr.hpp"
 #include "HFX/HFX.h"
+#include "Graphics/RenderGraph.h"
 #include "Serlalizer/Serializer.h"
 
 using namespace ST;
@@ -59,7 +60,9 @@ public:
 	virtual void Init() override
 	{
 		HFX::CompileHFX(PathManager::GetHFXDir() + "Ball.hfx");
-		TestSerializer();
+		if (HasArgument("--test-serializer")) { TestSerializer(); }
+		if (HasArgument("--benchmark-sort")) { graphics::BenchmarkCommandSort(); }
+		if (HasArgument("--test-recorder")) { graphics::TestCommandRecorder(); }
 // glfw: initialize and configure
 		// ------------------------------
 		glfwInit();
@@ -290,45 +293,58 @@ void Draw(graphics::Device& device)
 	// Load shader effect file.
 	ShaderEffect shader_effect;
 
+	// Shader code comes from the code chunks of the effect's passes.
 	PipelineCreation compute_pipeline_creation;
+	compute_pipeline_creation.AddShader(ShaderType::kCompute, "");
 	PipelineCreation graphics_pipeline_creation;
+	graphics_pipeline_creation.AddShader(ShaderType::kVertex, "")
+		.AddShader(ShaderType::kFragment, "")
+		.AddVertexStream(0, 3 * sizeof(float))
+		.AddVertexAttribute(0, 0, 0, VertexComponentFormat::Float3);
 	ResourceListLayoutCreation resource_list_layout_creation = shader_effect.CreateResourceListLayoutCreation();
-	std::shared_ptr<ResourceListLayout> resource_list_layout = device.CreateResourceListLayout(resource_list_layout_creation);
-	TextureCreation texture_creation = TextureCreation(
-		512,
-		512,
-		TextureFormat::R8G8B8A8_UNORM,
-		"CheckerTexture"
-	);
-	std::shared_ptr<Texture> render_target = device.CreateTexture(texture_creation);
+	ResourceHandle resource_list_layout = device.CreateResourceListLayout(resource_list_layout_creation);
 	BufferCreation buffer_creation = BufferCreation(
 		BufferType::Constant,
 		ResourceUsageType::Dynamic,
 		shader_effect.GetLocalConstantsSize(),
 		"LocalConstants"
 	);
-	std::shared_ptr<Buffer> local_constant_buffer = device.CreateBuffer(buffer_creation);
-	ResourceListCreation graphics_resource_list_creation = ResourceListCreation();
-	std::shared_ptr<ResourceList> graphics_resource_list = device.CreateResourceList(graphics_resource_list_creation);
-	
-	ResourceListCreation compute_resource_list_creation = ResourceListCreation();
-	std::shared_ptr<ResourceList> compute_resource_list = device.CreateResourceList(compute_resource_list_creation);
-	std::shared_ptr<Pipeline> compute_pipeline = device.CreatePipeline(compute_pipeline_creation);
-	std::shared_ptr<Pipeline> graphics_pipeline = device.CreatePipeline(graphics_pipeline_creation);
+	ResourceHandle local_constant_buffer = device.CreateBuffer(buffer_creation);
+	ResourceHandle compute_pipeline = device.CreatePipeline(compute_pipeline_creation);
+	ResourceHandle graphics_pipeline = device.CreatePipeline(graphics_pipeline_creation);
+	ResourceHandle full_screen_quad = VertexBufferFactory::CreateFullScreenQuad(device);
+
+	// The checker texture only lives between the two passes, the graph owns it and its resource lists.
+	RenderGraph render_graph(device);
+	render_graph.DeclareTexture("CheckerTexture", 512, 512, TextureFormat::R8G8B8A8_UNORM);
+	render_graph.ImportBuffer("LocalConstants", local_constant_buffer);
+	ResourceHandle compute_resource_list = kInvalidHandle;
+	ResourceHandle graphics_resource_list = kInvalidHandle;
+	render_graph.AddPass("Checker", PassType::kCompute, {"LocalConstants"}, {"CheckerTexture"},
+		[&](CommandBuffer& command_buffer, ResourceHandle)
+		{
+			command_buffer.BindPipeline(compute_pipeline);
+			command_buffer.BindResourceList(compute_resource_list);
+			command_buffer.Dispatch(512 / 32, 512 / 32, 1);
+		});
+	render_graph.AddPass("ToScreen", PassType::kGraphics, {"CheckerTexture"}, {},
+		[&](CommandBuffer& command_buffer, ResourceHandle)
+		{
+			command_buffer.BindPipeline(graphics_pipeline);
+			command_buffer.BindResourceList(graphics_resource_list);
+			command_buffer.BindVertexBuffer(full_screen_quad, 0, 0);
+			command_buffer.Draw(PrimitiveType::Triangle, 0, 3);
+		});
+	render_graph.Compile();
+
+	ResourceHandle checker_texture = render_graph.GetTexture("CheckerTexture");
+	compute_resource_list = device.CreateResourceList(ResourceListCreation()
+		.Add(ResourceType::kConstants, local_constant_buffer, 0)
+		.Add(ResourceType::kTextureRW, checker_texture, 1));
+	graphics_resource_list = device.CreateResourceList(ResourceListCreation().Add(ResourceType::kTexture, checker_texture, 0));
+
 	std::shared_ptr<CommandBuffer> command_buffer = device.ResetCommandBuffer();
-	{
-		command_buffer->BeginSubmit();
-		command_buffer->BindPipeline(compute_pipeline);
-		command_buffer->BindResourceList(compute_resource_list);
-		command_buffer->Dispatch(texture_creation.width_ / 32, texture_creation.height_ / 32, 1);
-		command_buffer->EndSubmit();
-	}
-	{
-		command_buffer->BeginSubmit();
-		command_buffer->BindPipeline(graphics_pipeline);
-		command_buffer->BindResourceList(graphics_resource_list);
-		command_buffer->BindVertexBuffer(VertexBufferFactory::CreateFullScreenQuad(), 0, 0);
-		command_buffer->Draw(PrimitiveType::Triangle, 0, 3);
-		command_buffer->EndSubmit();
-	}
+	render_graph.Execute(*command_buffer);
+	device.QueueCommandBuffer(command_buffer);
+	device.ExecuteCommandBuffers();
 }
\ No newline at end of file
@@ -3,8 +3,12 @@ layout (location=0) in vec3 v_Pos;
 layout (location=1) in vec3 v_Normal;
 layout (location=2) in vec2 v_TexCoord;
 
-uniform mat4 v_Model;
-uniform mat4 v_ViewProj;
+layout (location=3) in mat4 v_Model;
+layout (std140) uniform FrameConstants{
+    mat4 v_ViewProj;
+    mat4 v_SkyBoxViewProj;
+    vec3 f_EyePos;
+};
 
 out vec2 f_TexCoord;
 out vec3 f_FragPos;
@@ -14,5 +18,5 @@ void main(){
     gl_Position=v_ViewProj*v_Model*vec4(v_Pos,1.0f);
     f_FragPos=vec3(v_Model*vec4(v_Pos,1.0f));
     f_TexCoord=v_TexCoord;
-    f_Normal=vec3(transpose(inverse(v_Model))*vec4(v_Pos,1.0f));
+    f_Normal=mat3(transpose(inverse(v_Model)))*v_Normal;
 }
\ No newline at end of file
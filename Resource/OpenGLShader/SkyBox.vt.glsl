@@ -1,11 +1,15 @@
 #version 330 core
 layout (location=0) in vec3 v_Pos;
 
-uniform mat4 v_ViewProj;
+layout (std140) uniform FrameConstants{
+    mat4 v_ViewProj;
+    mat4 v_SkyBoxViewProj;
+    vec3 f_EyePos;
+};
 out vec3 f_TexCoord;
 
 void main(){
-    vec4 pos = v_ViewProj*vec4(v_Pos,1.0f);
+    vec4 pos = v_SkyBoxViewProj*vec4(v_Pos,1.0f);
     gl_Position=pos.xyww;
     f_TexCoord = v_Pos;
 }
\ No newline at end of file
@@ -100,6 +100,24 @@ void ST::ImguiPanel::CreateDirLightPanel(const char* name, ST_REF<DirLight> ligh
 	ImGui::End();
 }
 
+void ST::ImguiPanel::CreateRenderStatsPanel(const char* name, const Renderer3D::Stats& stats) {
+	ImGui::Begin(name, 0, ImGuiConfigFlags_DockingEnable | ImGuiConfigFlags_ViewportsEnable);
+	ImGui::Text("Submitted meshes: %u", stats._submittedMeshes);
+	ImGui::Text("Culled meshes: %u", stats._culledMeshes);
+	ImGui::Text("Draw calls: %u", stats._drawCalls);
+	ImGui::Text("Instances: %u", stats._instances);
+	ImGui::Text("Shader binds: %u", stats._shaderBinds);
+	ImGui::Text("Vertex array binds: %u", stats._vertexArrayBinds);
+	ImGui::Text("Material binds: %u", stats._materialBinds);
+	ImGui::Text("Static ranges: %u", stats._staticRanges);
+	ImGui::Text("Culled static ranges: %u", stats._culledStaticRanges);
+	ImGui::End();
+}
+
 void ST::ImguiPanel::ShowDemoPanel() {
 	ImGui::ShowDemoWindow();
 }
+
+bool ST::ImguiPanel::WantCaptureMouse() {
+	return ImGui::GetIO().WantCaptureMouse;
+}
@@ -15,7 +15,10 @@ namespace  ST
         static void NewFrame();
         static void CreatePointLightPanel(const char* name,ST_REF<PointLight> light);
         static void CreateDirLightPanel(const char* name,ST_REF<DirLight> light);
+        static void CreateRenderStatsPanel(const char* name,const Renderer3D::Stats& stats);
         static void ShowDemoPanel();
+        // True while the mouse is over a panel, clicks then belong to the UI rather than the scene.
+        static bool WantCaptureMouse();
     };
 }
 
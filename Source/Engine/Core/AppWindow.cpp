@@ -21,6 +21,9 @@
 #include "Render/Model.h"
 #include "Render/Material.h"
 #include "Render/Renderer2D.h"
+#include "Render/ResourceReleaseQueue.h"
+#include "Render/StaticBatch.h"
+#include "Render/TextureUploadQueue.h"
 #include "UI/UI_Image.h"
 
 // #include "glad/glad.h"
@@ -94,27 +97,37 @@ void ST::AppWindow::InitWindow(Application* app) {
 
 	_gameObjects.emplace_back(ST_MAKE_REF<GameObject>());
 	_gameObjects.back()->SetModel(ST_MAKE_REF<Model>(ST_VECTOR<ST_REF<Mesh>>{planeMesh}));
-	_gameObjects.back()->_transform = Transform{};
+	_gameObjects.back()->SetTransform(Transform{});
+	_gameObjects.back()->_static = true;
 
 	_gameObjects.emplace_back(ST_MAKE_REF<GameObject>());
 	_gameObjects.back()->SetModel(ST_MAKE_REF<Model>(ST_VECTOR<ST_REF<Mesh>>{cubeMesh}));
-	_gameObjects.back()->_transform = Transform{{10, 0, 0}, {}, {10, 10, 5}};
+	_gameObjects.back()->SetTransform(Transform{{10, 0, 0}, {}, {10, 10, 5}});
+	_gameObjects.back()->_static = true;
 
 	_gameObjects.emplace_back(ST_MAKE_REF<GameObject>());
 	_gameObjects.back()->SetModel(ST_MAKE_REF<Model>(ST_VECTOR<ST_REF<Mesh>>{cubeMesh}));
-	_gameObjects.back()->_transform = Transform{{10, -10, 10}};
+	_gameObjects.back()->SetTransform(Transform{{10, -10, 10}});
 
 	_selectedGameObject = _gameObjects.back();
 	
 	_gameObjects.emplace_back(ST_MAKE_REF<GameObject>());
 	_gameObjects.back()->SetModel(ST_MAKE_REF<Model>(ST_VECTOR<ST_REF<Mesh>>{cubeMesh}));
-	_gameObjects.back()->_transform = Transform{{30, 20, 10}};
+	_gameObjects.back()->SetTransform(Transform{{30, 20, 10}});
+	_gameObjects.back()->_static = true;
 	
 
 	_gameObjects.emplace_back(ST_MAKE_REF<GameObject>());
 	_gameObjects.back()->SetModel(
 		ResourceManager::GetResourceManager().LoadModel("/Resource/Model/nanosuit/nanosuit.obj"));
-	_gameObjects.back()->_transform = Transform{{}, {0, 0, 0},};
+	_gameObjects.back()->SetTransform(Transform{{}, {0, 0, 0},});
+	_gameObjects.back()->_static = true;
+
+	for (auto& gameObject : _gameObjects) {
+		gameObject->_bvhProxy    = _sceneBVH.Insert(gameObject.get(), gameObject->GetWorldBounds());
+		gameObject->_boundsDirty = false;
+	}
+	_staticBatch = ST_MAKE_REF<StaticBatch>(_gameObjects);
 
 	_skyBox=cubeMesh;
 	
@@ -145,6 +158,9 @@ void ST::AppWindow::InitWindow(Application* app) {
 				MouseButtonPressedEvent pressedEvent(button);
 				userData->_app->OnEvent(*userData->_appWindow, pressedEvent);
 				userData->_appWindow->_canvas->OnEvent(*userData->_appWindow, pressedEvent);
+				if (button == GLFW_MOUSE_BUTTON_LEFT && !ImguiPanel::WantCaptureMouse()) {
+					userData->_appWindow->PickGameObject();
+				}
 				break;
 			}
 			case ST_RELEASE: {
@@ -205,6 +221,13 @@ void ST::AppWindow::Tick(float deltaTime) {
 	_cameraController->Tick(deltaTime);
 	_camera->UpdateCameraMat();
 	glfwPollEvents();
+	// Static objects never move and clean ones keep their proxy, so only moved objects pay for GetWorldBounds.
+	for (auto& gameObject : _gameObjects) {
+		if (gameObject->_static || !gameObject->_boundsDirty)
+			continue;
+		_sceneBVH.Update(gameObject->_bvhProxy, gameObject->GetWorldBounds());
+		gameObject->_boundsDirty = false;
+	}
 
 }
 
@@ -212,44 +235,51 @@ using namespace ST;
 
 void ST::AppWindow::Render() {
 
+	ResourceReleaseQueue::GetResourceReleaseQueue().BeginFrame();
+	TextureUploadQueue::GetTextureUploadQueue().Update();
 	
 	glStencilMask(0xFF); // glStencilMask(0x00) cause clearing stencil buffer bit not work
 	_renderer3D->PostProcessRecordBegin();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	glDepthFunc(GL_LESS);
 	ImguiPanel::NewFrame();
+	_renderer3D->BeginFrame(_camera);
 
 	/* Draw game objects */
 	glStencilFunc(GL_ALWAYS,0,0xFF);
 	glStencilMask(0x00);
 	_renderer3D->BeginDraw(ResourceManager::GetResourceManager().LoadShader(
 		"/Resource/OpenGLShader/BoxShader.vt.glsl",
-		"/Resource/OpenGLShader/BoxShader.fg.glsl"), _camera);
+		"/Resource/OpenGLShader/BoxShader.fg.glsl"));
 	_renderer3D->SetLight();
 
-	for (auto& gameObject : _gameObjects) {
-		if(gameObject!=_selectedGameObject) {
-			_renderer3D->DrawGameObject(gameObject);
+	_sceneBVH.QueryFrustum(_renderer3D->GetCuller().GetPlanes(), [this](GameObject* gameObject) {
+		if (!gameObject->_static && gameObject != _selectedGameObject.get()) {
+			_renderer3D->SubmitGameObject(*gameObject);
 		}
-	}
+	});
+	_renderer3D->FlushGameObjects();
+	_renderer3D->DrawStaticBatch(*_staticBatch, _selectedGameObject.get());
 	glDepthFunc(GL_LEQUAL);
-	_renderer3D->BeginDrawSkyBox(ResourceManager::GetResourceManager().LoadShader(
+	_renderer3D->BeginDraw(ResourceManager::GetResourceManager().LoadShader(
 		"/Resource/OpenGLShader/SkyBox.vt.glsl",
-		"/Resource/OpenGLShader/SkyBox.fg.glsl"), _camera);
+		"/Resource/OpenGLShader/SkyBox.fg.glsl"));
 	_renderer3D->DrawSkyBox(_skyBox);
 	glDepthFunc(GL_LESS);
 
 	/* Draw selected game obj*/
 	glStencilFunc(GL_ALWAYS,1,0xFF);
 	glStencilMask(0xFF);
-	_renderer3D->DrawGameObject(_selectedGameObject);
+	if (_selectedGameObject) {
+		_renderer3D->DrawGameObject(_selectedGameObject);
+	}
 	
 	glStencilFunc(GL_NOTEQUAL,1,0xFF);
 	glStencilMask(0x00);
 	glDisable(GL_DEPTH_TEST);
 	_renderer3D->BeginDraw(ResourceManager::GetResourceManager().LoadShader(
 		"/Resource/OpenGLShader/PureColorShader.vt.glsl",
-		"/Resource/OpenGLShader/PureColorShader.fg.glsl"), _camera);
+		"/Resource/OpenGLShader/PureColorShader.fg.glsl"));
 
 	// _renderer3D->DrawScaledGameObjectByColor(_selectedGameObject,
 	// 	{1.2, 1.2, 1.2}, {1, 1, 1, 1});
@@ -274,16 +304,20 @@ void ST::AppWindow::Render() {
 	glClear(GL_COLOR_BUFFER_BIT);
 	_renderer3D->BeginDraw(ResourceManager::GetResourceManager().LoadShader(
 		"/Resource/OpenGLShader/PostProcessingShader.vt.glsl",
-		"/Resource/OpenGLShader/PostProcessingShader.fg.glsl"), _camera);
+		"/Resource/OpenGLShader/PostProcessingShader.fg.glsl"));
 	_renderer3D->BeginPostProcess();
 	_renderer3D->DrawQuad(_postProcessingQuad);
 	glEnable(GL_DEPTH_TEST);
 
+	ImguiPanel::CreateRenderStatsPanel("Render Stats", _renderer3D->GetStats());
 	ImguiPanel::Render();
 	glfwSwapBuffers(_window);
+	ResourceReleaseQueue::GetResourceReleaseQueue().EndFrame();
 }
 
 void ST::AppWindow::Destroy() {
+	TextureUploadQueue::GetTextureUploadQueue().Shutdown();
+	ResourceReleaseQueue::GetResourceReleaseQueue().Shutdown();
 	ImguiPanel::Close();
 }
 
@@ -306,3 +340,32 @@ double ST::AppWindow::GetCurrentWindowTime() const {
 ST_EVENT_ACTION ST::AppWindow::GetKeyAction(ST_KEY_TYPE key) {
 	return glfwGetKey(_window, key);
 }
+
+void ST::AppWindow::PickGameObject() {
+	double xPos, yPos, xSize, ySize;
+	glfwGetCursorPos(_window, &xPos, &yPos);
+	GetWindowSize(xSize, ySize);
+	const glm::vec2 ndc(2.0 * xPos / xSize - 1.0, 1.0 - 2.0 * yPos / ySize);
+
+	// Unprojects the cursor on the near and far planes.
+	const glm::mat4 invViewProj = glm::inverse(_camera->GetViewPorjMat());
+	glm::vec4 nearPos           = invViewProj * glm::vec4(ndc, -1.f, 1.f);
+	glm::vec4 farPos            = invViewProj * glm::vec4(ndc, 1.f, 1.f);
+	nearPos /= nearPos.w;
+	farPos /= farPos.w;
+	const glm::vec3 origin = glm::vec3(nearPos);
+	const float maxT       = glm::length(glm::vec3(farPos) - origin);
+	const glm::vec3 dir    = (glm::vec3(farPos) - origin) / maxT;
+
+	float hitT             = maxT;
+	GameObject* gameObject = _sceneBVH.RayCast(origin, dir, maxT, [&](GameObject* candidate, float closestT) {
+		return candidate->RayIntersect(origin, dir, closestT);
+	}, hitT);
+	_selectedGameObject = nullptr;
+	for (auto& candidate : _gameObjects) {
+		if (candidate.get() == gameObject) {
+			_selectedGameObject = candidate;
+			break;
+		}
+	}
+}
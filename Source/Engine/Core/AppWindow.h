@@ -2,6 +2,7 @@
 
 #include "Core.h"
 #include "Event/EventCode.h"
+#include "SceneBVH.h"
 #include "Render/Renderer3D.h"
 
 /*
@@ -18,6 +19,8 @@ class Renderer2D;
 
 class Canvas;
 
+class StaticBatch;
+
 class AppWindow //:public std::enable_shared_from_this<AppWindow>
 {
 public:
@@ -39,6 +42,9 @@ public:
 
 	ST_EVENT_ACTION GetKeyAction(ST_KEY_TYPE key);
 
+	// Selects the closest game object under the mouse, or clears the selection when nothing is hit.
+	void PickGameObject();
+
 	int _width;
 
 	int _height;
@@ -75,6 +81,12 @@ private:
 
 	ST_VECTOR<ST_REF<GameObject>> _gameObjects;
 
+	// World space bounds of _gameObjects, refit in Tick for the objects that moved.
+	SceneBVH _sceneBVH;
+
+	// Meshes of the static _gameObjects merged by material.
+	ST_REF<StaticBatch> _staticBatch;
+
 	ST_REF<Mesh> _skyBox;
 
 	ST_REF<GameObject> _selectedGameObject;
@@ -1,4 +1,5 @@
 #include "Application.h"
+#include <algorithm>
 #include "AppWindow.h"
 #include "Core.h"
 #include "PathManager.h"
@@ -28,6 +29,14 @@ float ST::Application::GetAPPCurrentTime() {
 	return _window->GetCurrentWindowTime();
 }
 
+void ST::Application::SetArguments(int argc, char* argv[]) {
+	_arguments.assign(argv + 1, argv + argc);
+}
+
+bool ST::Application::HasArgument(const std::string& argument) const {
+	return std::find(_arguments.begin(), _arguments.end(), argument) != _arguments.end();
+}
+
 void ST::Application::OnEvent(const AppWindow& appWindow, const Event& e) {
 	EventDisPatcher dispatcher;
 	// std::bind(&OnWindowClosed,this,std::placeholders::_1);
@@ -1,4 +1,6 @@
 #pragma once
+#include <string>
+#include <vector>
 #include "Event/Event.h"
 
 namespace ST {
@@ -24,6 +26,11 @@ public:
 
 	virtual float GetAPPCurrentTime();
 
+	// Keeps the command line so Init can look for opt-in switches such as test or benchmark runs.
+	void SetArguments(int argc, char* argv[]);
+
+	bool HasArgument(const std::string& argument) const;
+
 #pragma region /** Event */
 	void OnEvent(const AppWindow& appWindow, const Event& e);
 
@@ -36,6 +43,8 @@ public:
 protected:
 	bool _shouldClose;
 
+	std::vector<std::string> _arguments;
+
 	ST_REF<AppWindow> _window;
 
 };
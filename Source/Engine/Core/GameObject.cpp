@@ -1 +1,60 @@
 #include "GameObject.h"
+
+#include "Render/Mesh.h"
+#include "Render/Model.h"
+
+namespace ST {
+AABB GameObject::GetWorldBounds() const {
+	AABB bounds;
+	if (!_model) {
+		return bounds;
+	}
+	const glm::mat4 modelMat = _transform.GetModelMat();
+	for (auto& mesh : _model->_meshes) {
+		bounds.Merge(AABB(mesh->_boundsMin, mesh->_boundsMax).Transformed(modelMat));
+	}
+	return bounds;
+}
+
+float GameObject::RayIntersect(const glm::vec3& origin, const glm::vec3& dir, float maxT) const {
+	if (!_model) {
+		return -1.f;
+	}
+	// The ray is moved into object space without normalizing dir, so distances along it stay world space distances.
+	const glm::mat4 invModelMat = glm::inverse(_transform.GetModelMat());
+	const glm::vec3 localOrigin = glm::vec3(invModelMat * glm::vec4(origin, 1.f));
+	const glm::vec3 localDir    = glm::vec3(invModelMat * glm::vec4(dir, 0.f));
+	float closestT              = maxT;
+	bool hit                    = false;
+	for (auto& mesh : _model->_meshes) {
+		const uint32_t count = static_cast<uint32_t>(mesh->_hasIndices ? mesh->_indices.size() : mesh->_verts.size());
+		for (uint32_t i = 0; i + 2 < count; i += 3) {
+			const glm::vec3& p0 = mesh->_verts[mesh->_hasIndices ? mesh->_indices[i] : i]._pos;
+			const glm::vec3& p1 = mesh->_verts[mesh->_hasIndices ? mesh->_indices[i + 1] : i + 1]._pos;
+			const glm::vec3& p2 = mesh->_verts[mesh->_hasIndices ? mesh->_indices[i + 2] : i + 2]._pos;
+			// Moller-Trumbore, both faces count as hits.
+			const glm::vec3 edge1 = p1 - p0;
+			const glm::vec3 edge2 = p2 - p0;
+			const glm::vec3 p     = glm::cross(localDir, edge2);
+			const float det       = glm::dot(edge1, p);
+			if (glm::abs(det) < 1e-8f)
+				continue;
+			const float invDet = 1.f / det;
+			const glm::vec3 s  = localOrigin - p0;
+			const float u      = glm::dot(s, p) * invDet;
+			if (u < 0.f || u > 1.f)
+				continue;
+			const glm::vec3 q = glm::cross(s, edge1);
+			const float v     = glm::dot(localDir, q) * invDet;
+			if (v < 0.f || u + v > 1.f)
+				continue;
+			const float t = glm::dot(edge2, q) * invDet;
+			if (t >= 0.f && t < closestT) {
+				closestT = t;
+				hit      = true;
+			}
+		}
+	}
+	return hit ? closestT : -1.f;
+}
+}
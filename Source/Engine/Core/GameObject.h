@@ -1,5 +1,7 @@
 #pragma once
 #include "Core.h"
+#include "SceneBVH.h"
+#include "Math/AABB.h"
 #include "Math/Transform.h"
 
 namespace ST {
@@ -8,11 +10,35 @@ class Model;
 class GameObject {
 public:
 	void SetModel(ST_REF<Model> model) {
-		_model = model;
+		_model       = model;
+		_boundsDirty = true;
 	}
 
+	// Moves the object; its scene BVH proxy is refit on the next Tick.
+	void SetTransform(const Transform& transform) {
+		_transform   = transform;
+		_boundsDirty = true;
+	}
+
+	// World space box of the model meshes under _transform.
+	AABB GetWorldBounds() const;
+
+	// Returns the distance along dir to the closest model triangle hit by the world space ray, or -1 when no triangle is
+	// hit within maxT.
+	float RayIntersect(const glm::vec3& origin, const glm::vec3& dir, float maxT) const;
+
+	// Written through SetTransform so that _boundsDirty stays in sync.
 	Transform _transform;
 
 	ST_REF<Model> _model;
+
+	// Leaf of the object in the scene BVH, kept by the owner of the tree.
+	int32_t _bvhProxy = SceneBVH::NULL_NODE;
+
+	// Static objects are baked into a StaticBatch when the scene loads and must not move afterwards.
+	bool _static = false;
+
+	// Set when _transform or _model changed since the scene BVH proxy was last refit.
+	bool _boundsDirty = true;
 };
 }
@@ -0,0 +1,66 @@
+#pragma once
+#include <cfloat>
+
+#include "glm.hpp"
+
+namespace ST {
+// Axis aligned box, empty (min > max) by default so the first Merge sets it.
+struct AABB {
+	AABB(const glm::vec3& min = glm::vec3(FLT_MAX), const glm::vec3& max = glm::vec3(-FLT_MAX)): _min(min), _max(max) {}
+
+	glm::vec3 _min;
+
+	glm::vec3 _max;
+
+	inline bool IsEmpty() const {
+		return _min.x > _max.x || _min.y > _max.y || _min.z > _max.z;
+	}
+
+	inline glm::vec3 GetCenter() const {
+		return (_min + _max) * 0.5f;
+	}
+
+	inline glm::vec3 GetExtents() const {
+		return (_max - _min) * 0.5f;
+	}
+
+	// Half the surface area, the cost a tree pays for descending into the box.
+	inline float GetArea() const {
+		const glm::vec3 size = _max - _min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	inline void Merge(const AABB& other) {
+		_min = glm::min(_min, other._min);
+		_max = glm::max(_max, other._max);
+	}
+
+	inline bool Contains(const AABB& other) const {
+		return glm::all(glm::lessThanEqual(_min, other._min)) && glm::all(glm::lessThanEqual(other._max, _max));
+	}
+
+	inline AABB Expanded(float margin) const {
+		return AABB(_min - glm::vec3(margin), _max + glm::vec3(margin));
+	}
+
+	// Box containing this box transformed by mat.
+	inline AABB Transformed(const glm::mat4& mat) const {
+		const glm::vec3 center  = glm::vec3(mat * glm::vec4(GetCenter(), 1.f));
+		const glm::mat3 absMat  = glm::mat3(glm::abs(glm::vec3(mat[0])), glm::abs(glm::vec3(mat[1])),
+			glm::abs(glm::vec3(mat[2])));
+		const glm::vec3 extents = absMat * GetExtents();
+		return AABB(center - extents, center + extents);
+	}
+
+	// Slab test, returns the distance along dir where the ray enters the box, or -1 when it misses within maxT.
+	inline float RayIntersect(const glm::vec3& origin, const glm::vec3& invDir, float maxT) const {
+		const glm::vec3 t0    = (_min - origin) * invDir;
+		const glm::vec3 t1    = (_max - origin) * invDir;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar  = glm::max(t0, t1);
+		const float enter     = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+		const float exit      = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+		return enter <= exit ? enter : -1.f;
+	}
+};
+}
@@ -1 +1,13 @@
 #include "Transform.h"
+
+#include "MathLibrary.h"
+#include "gtc/quaternion.hpp"
+#include "gtx/transform.hpp"
+
+glm::mat4 ST::Transform::GetModelMat() const {
+	glm::mat4 modelTrans(1.0);
+	modelTrans = scale(modelTrans, _scale);
+	modelTrans = mat4_cast(MathLibrary::EulerToQuat(_rotator)) * modelTrans;
+	modelTrans = translate(modelTrans, _pos);
+	return modelTrans;
+}
@@ -13,6 +13,8 @@ struct Transform {
 	glm::vec3 _rotator = glm::vec3(0);
 
 	glm::vec3 _scale = glm::vec3(1);
+
+	glm::mat4 GetModelMat() const;
 };
 
 }
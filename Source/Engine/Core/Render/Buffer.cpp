@@ -12,6 +12,11 @@ VertexBuffer::VertexBuffer(const float* verts, uint32_t size, BufferMode mode):
 		glBufferData(GL_ARRAY_BUFFER, size, verts,GL_DYNAMIC_DRAW);
 }
 
+void VertexBuffer::SetData(const void* data, uint32_t size) {
+	glBindBuffer(GL_ARRAY_BUFFER, _bufferId);
+	glBufferData(GL_ARRAY_BUFFER, size, data, _mode == BufferMode::STATIC_BUFFER ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+}
+
 // Ref<VertexBuffer> VertexBuffer::CreateVertexBuffer(const float* verts)
 // {
 //     return MakeRef<VertexBuffer>(verts);
@@ -23,6 +28,24 @@ IndexBuffer::IndexBuffer(const uint32_t* Indexs, uint32_t size) {
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, Indexs,GL_STATIC_DRAW);
 }
 
+UniformBuffer::UniformBuffer(uint32_t size, uint32_t binding): _size(size) {
+	glGenBuffers(1, &_bufferId);
+	glBindBuffer(GL_UNIFORM_BUFFER, _bufferId);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr,GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, _bufferId);
+}
+
+void UniformBuffer::SetData(const void* data, uint32_t size) {
+	if (size > _size) {
+		ST_ERROR("Uniform buffer overflow! %u > %u\n", size, _size);
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, _bufferId);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 FrameBuffer::FrameBuffer(unsigned int width, unsigned int height) {
 	glGenFramebuffers(1, &_bufferId);
 	glBindFramebuffer(GL_FRAMEBUFFER, _bufferId);
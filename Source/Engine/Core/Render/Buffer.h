@@ -2,6 +2,7 @@
 #include"Core.h"
 #include"ShaderDataType.h"
 #include "pch.h"
+#include "ResourceReleaseQueue.h"
 #include "Shader.h"
 #include "Texture2D.h"
 #include "VertexArray.h"
@@ -16,9 +17,13 @@ struct LayoutParam;
 struct BufferLayout {
 	ST_VECTOR<LayoutParam> s_Params;
 
+	// Attributes advance once per instance instead of once per vertex.
+	bool _perInstance = false;
+
 	inline BufferLayout() {}
 
-	inline BufferLayout(std::initializer_list<LayoutParam> initialList): s_Params(initialList) {}
+	inline BufferLayout(std::initializer_list<LayoutParam> initialList, bool perInstance = false):
+		s_Params(initialList), _perInstance(perInstance) {}
 
 	inline ST_VECTOR<LayoutParam>::iterator begin() {
 		return s_Params.begin();
@@ -69,7 +74,7 @@ public:
 	VertexBuffer(const float* verts, uint32_t size, BufferMode mode);
 
 	~VertexBuffer() {
-		glDeleteBuffers(1, &_bufferId);
+		ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::BUFFER, _bufferId);
 	}
 
 	// static Ref<VertexBuffer> CreateVertexBuffer(const float* Verts);
@@ -82,6 +87,9 @@ public:
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
+	// Reallocates the storage, vertex arrays referencing the buffer keep working.
+	void SetData(const void* data, uint32_t size);
+
 	void SetLayout(const BufferLayout& bufferLayer) {
 		_bufferLayout = bufferLayer;
 	}
@@ -101,7 +109,7 @@ public:
 	IndexBuffer(const uint32_t* indexs, uint32_t size);
 
 	~IndexBuffer() {
-		glDeleteBuffers(1, &_bufferId);
+		ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::BUFFER, _bufferId);
 	}
 
 	inline void Bind() {
@@ -113,6 +121,24 @@ public:
 	}
 };
 
+// Uniform block storage bound to a fixed binding point, shared by every program that declares the block.
+class UniformBuffer {
+private:
+	unsigned int _bufferId;
+
+	uint32_t _size;
+
+public:
+	UniformBuffer(uint32_t size, uint32_t binding);
+
+	~UniformBuffer() {
+		ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::BUFFER, _bufferId);
+	}
+
+	// Replaces the whole block.
+	void SetData(const void* data, uint32_t size);
+};
+
 class FrameBuffer {
 private:
 	class RenderBuffer {
@@ -124,6 +150,10 @@ private:
 	public:
 		RenderBuffer(unsigned int width, unsigned int height);
 
+		~RenderBuffer() {
+			ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::RENDERBUFFER, _bufferId);
+		}
+
 		inline void Bind() {
 			glBindRenderbuffer(GL_RENDERBUFFER, _bufferId);
 		}
@@ -143,7 +173,7 @@ public:
 	FrameBuffer(unsigned int width, unsigned int height);
 
 	~FrameBuffer() {
-		glDeleteBuffers(1, &_bufferId);
+		ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::FRAMEBUFFER, _bufferId);
 	}
 
 	inline void Bind() {
@@ -0,0 +1,76 @@
+#include "FrustumCuller.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define ST_FRUSTUM_CULLER_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace ST {
+void FrustumCuller::SetViewProj(const glm::mat4& viewProj) {
+	const glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+	const glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+	const glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+	const glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+	_planes[0] = row3 + row0;
+	_planes[1] = row3 - row0;
+	_planes[2] = row3 + row1;
+	_planes[3] = row3 - row1;
+	_planes[4] = row3 + row2;
+	_planes[5] = row3 - row2;
+	for (auto& plane : _planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+}
+
+void FrustumCuller::Clear() {
+	_centerX.clear();
+	_centerY.clear();
+	_centerZ.clear();
+	_radius.clear();
+}
+
+uint32_t FrustumCuller::AddSphere(const glm::vec3& center, float radius) {
+	_centerX.push_back(center.x);
+	_centerY.push_back(center.y);
+	_centerZ.push_back(center.z);
+	_radius.push_back(radius);
+	return static_cast<uint32_t>(_radius.size() - 1);
+}
+
+uint32_t FrustumCuller::Cull(ST_VECTOR<uint8_t>& visible) const {
+	const uint32_t count = GetSphereCount();
+	visible.resize(count);
+	uint32_t culled = 0;
+	uint32_t i      = 0;
+#ifdef ST_FRUSTUM_CULLER_SSE
+	for (; i + 4 <= count; i += 4) {
+		const __m128 x         = _mm_loadu_ps(&_centerX[i]);
+		const __m128 y         = _mm_loadu_ps(&_centerY[i]);
+		const __m128 z         = _mm_loadu_ps(&_centerZ[i]);
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&_radius[i]));
+		__m128 inside          = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+		for (const auto& plane : _planes) {
+			__m128 distance = _mm_mul_ps(x, _mm_set1_ps(plane.x));
+			distance        = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+			distance        = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+			distance        = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+			inside          = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+		const int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4; ++lane) {
+			visible[i + lane] = (mask >> lane) & 1;
+			culled += 1 - visible[i + lane];
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		bool inside = true;
+		for (const auto& plane : _planes) {
+			inside &= plane.x * _centerX[i] + plane.y * _centerY[i] + plane.z * _centerZ[i] + plane.w >= -_radius[i];
+		}
+		visible[i] = inside;
+		culled += !inside;
+	}
+	return culled;
+}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "Core.h"
+#include "glm.hpp"
+
+namespace ST {
+/*
+ * Tests batches of world space bounding spheres against the view frustum.
+ *
+ * Spheres are stored as separate x, y, z and radius arrays so Cull can test four of them per plane with SSE. A sphere
+ * is culled once it lies entirely behind one of the six planes, which keeps a few spheres near the frustum corners that
+ * are not actually visible.
+ */
+class FrustumCuller {
+public:
+	// Extracts the frustum planes of a GL clip space view projection matrix.
+	void SetViewProj(const glm::mat4& viewProj);
+
+	void Clear();
+
+	// Returns the index of the sphere in the visibility written by Cull.
+	uint32_t AddSphere(const glm::vec3& center, float radius);
+
+	// Sets visible[i] to 1 for every sphere intersecting the frustum and 0 otherwise, returns the number culled.
+	uint32_t Cull(ST_VECTOR<uint8_t>& visible) const;
+
+	inline uint32_t GetSphereCount() const {
+		return static_cast<uint32_t>(_radius.size());
+	}
+
+	// Left, right, bottom, top, near and far planes of the last SetViewProj.
+	inline const glm::vec4* GetPlanes() const {
+		return _planes;
+	}
+
+private:
+	// xyz is the inward normal, w the distance, so inside points have dot(plane, vec4(p, 1)) >= 0.
+	glm::vec4 _planes[6];
+
+	ST_VECTOR<float> _centerX;
+
+	ST_VECTOR<float> _centerY;
+
+	ST_VECTOR<float> _centerZ;
+
+	ST_VECTOR<float> _radius;
+};
+}
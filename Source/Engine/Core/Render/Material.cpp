@@ -3,20 +3,38 @@
 #include "ResourceManager.h"
 #include "Texture2D.h"
 
+void ST::Material::SetTexPath(int idx, const ST_STRING& path) {
+	switch (idx) {
+		case 1: _ambientTexPath = path;
+			break;
+		case 2: _diffuseTexPath = path;
+			break;
+		case 3: _specularTexPath = path;
+			break;
+	}
+	_textureGeneration = 0;
+}
+
 void ST::Material::Bind() {
-	ST_REF<Texture2D> _ambientTex  = ResourceManager::GetResourceManager().LoadTexture(_ambientTexPath);
-	ST_REF<Texture2D> _diffuseTex  = ResourceManager::GetResourceManager().LoadTexture(_diffuseTexPath);
-	ST_REF<Texture2D> _specularTex = ResourceManager::GetResourceManager().LoadTexture(_specularTexPath);
-	_ambientTex->Bind(_idx * 3);
-	_diffuseTex->Bind(_idx * 3 + 1);
-	_specularTex->Bind(_idx * 3 + 2);
+	if (_textureGeneration != ResourceManager::GetResourceManager().GetTextureGeneration())
+		ResolveTextures();
+	_textures[0]->Bind(_idx * 3);
+	_textures[1]->Bind(_idx * 3 + 1);
+	_textures[2]->Bind(_idx * 3 + 2);
 }
 
 void ST::Material::UnBind() {
-	ST_REF<Texture2D> _ambientTex  = ResourceManager::GetResourceManager().LoadTexture(_ambientTexPath);
-	ST_REF<Texture2D> _diffuseTex  = ResourceManager::GetResourceManager().LoadTexture(_diffuseTexPath);
-	ST_REF<Texture2D> _specularTex = ResourceManager::GetResourceManager().LoadTexture(_specularTexPath);
-	_ambientTex->UnBind(_idx * 3);
-	_diffuseTex->UnBind(_idx * 3 + 1);
-	_specularTex->UnBind(_idx * 3 + 2);
+	if (_textureGeneration != ResourceManager::GetResourceManager().GetTextureGeneration())
+		ResolveTextures();
+	_textures[0]->UnBind(_idx * 3);
+	_textures[1]->UnBind(_idx * 3 + 1);
+	_textures[2]->UnBind(_idx * 3 + 2);
+}
+
+void ST::Material::ResolveTextures() {
+	ResourceManager& resourceManager = ResourceManager::GetResourceManager();
+	_textures[0]                     = resourceManager.LoadTexture(_ambientTexPath);
+	_textures[1]                     = resourceManager.LoadTexture(_diffuseTexPath);
+	_textures[2]                     = resourceManager.LoadTexture(_specularTexPath);
+	_textureGeneration               = resourceManager.GetTextureGeneration();
 }
@@ -4,6 +4,8 @@
 namespace ST {
 #define MATERIAL_DEFAULT_TEXTURE_PATH "/Resource/White.jpg"
 
+class Texture2D;
+
 class Material {
 public:
 	Material(): _ambientTexPath(MATERIAL_DEFAULT_TEXTURE_PATH),
@@ -14,7 +16,7 @@ public:
 		float shinness = 32.f, int idx = 0): _idx(idx), _shinness(shinness),
 		_ambientTexPath(ambientTexPath), _diffuseTexPath(diffuseTexPath), _specularTexPath(specularTexPath) {};
 
-	ST_STRING& GetTexPath(int idx) {
+	const ST_STRING& GetTexPath(int idx) const {
 		switch (idx) {
 			case 1: return _ambientTexPath;
 			case 2: return _diffuseTexPath;
@@ -23,19 +25,32 @@ public:
 		return _ambientTexPath;
 	}
 
+	// Same indices as GetTexPath, the textures are resolved again by the next Bind.
+	void SetTexPath(int idx, const ST_STRING& path);
+
 	int _idx = 0;
 
 	float _shinness = 32.f;
 
+	// Resolves the texture paths through the ResourceManager on first use and again only after a path changes or a
+	// texture is unloaded, later binds reuse the resolved textures.
 	void Bind();
 
 	void UnBind();
 
+private:
+	void ResolveTextures();
+
 	ST_STRING _ambientTexPath;
 
 	ST_STRING _diffuseTexPath;
 
 	ST_STRING _specularTexPath;
 
+	// Ambient, diffuse and specular, valid while _textureGeneration matches the ResourceManager.
+	ST_REF<Texture2D> _textures[3];
+
+	// 0 until the first resolve, the ResourceManager generation starts at 1.
+	uint32_t _textureGeneration = 0;
 };
 }
@@ -14,5 +14,27 @@ void ST::Mesh::SetUpMesh() {
 	_vertexArray->AddVertexBuffer(vertexBuffer);
 	auto idxBuffer = ST_MAKE_REF<IndexBuffer>(_indices.data(), sizeof(unsigned int) * _indices.size());
 	_vertexArray->SetIndexBuffer(idxBuffer);
+	ComputeBounds();
+}
+
+void ST::Mesh::ComputeBounds() {
+	if (_verts.empty()) {
+		_boundsMin = _boundsMax = _boundsCenter = glm::vec3{};
+		_boundsRadius = 0.f;
+		return;
+	}
+	_boundsMin = _boundsMax = _verts[0]._pos;
+	for (const auto& vert : _verts) {
+		_boundsMin = glm::min(_boundsMin, vert._pos);
+		_boundsMax = glm::max(_boundsMax, vert._pos);
+	}
+	// Centered on the box, but only as large as the farthest vertex needs rather than the box diagonal.
+	_boundsCenter      = (_boundsMin + _boundsMax) * 0.5f;
+	float radiusSquare = 0.f;
+	for (const auto& vert : _verts) {
+		const glm::vec3 offset = vert._pos - _boundsCenter;
+		radiusSquare           = glm::max(radiusSquare, glm::dot(offset, offset));
+	}
+	_boundsRadius = glm::sqrt(radiusSquare);
 }
 
@@ -35,6 +35,8 @@ public:
 
 	void SetUpMesh();
 
+	void ComputeBounds();
+
 	ST_VECTOR<Vertex> _verts;
 
 	ST_VECTOR<unsigned int> _indices;
@@ -43,6 +45,15 @@ public:
 
 	bool _hasIndices = false;
 
+	// Object space bounds of _verts, computed by SetUpMesh.
+	glm::vec3 _boundsMin{};
+
+	glm::vec3 _boundsMax{};
+
+	glm::vec3 _boundsCenter{};
+
+	float _boundsRadius = 0.f;
+
 	ST_REF<VertexArray> _vertexArray;
 
 };
@@ -84,13 +84,13 @@ void ST::Model::GetTextures(ST_VECTOR<ST_REF<Material>>& materials, aiMaterial*
 		aiString str;
 		aiMaterials->GetTexture(type, i, &str);
 		switch (type) {
-			case aiTextureType_AMBIENT: materials[i]->_ambientTexPath = _dicPath + str.C_Str();
+			case aiTextureType_AMBIENT: materials[i]->SetTexPath(1, _dicPath + str.C_Str());
 				break;
-			case aiTextureType_DIFFUSE: materials[i]->_diffuseTexPath = _dicPath + str.C_Str();
-				if (materials[i]->_ambientTexPath == MATERIAL_DEFAULT_TEXTURE_PATH)
-					materials[i]->_ambientTexPath = materials[i]->_diffuseTexPath;
+			case aiTextureType_DIFFUSE: materials[i]->SetTexPath(2, _dicPath + str.C_Str());
+				if (materials[i]->GetTexPath(1) == MATERIAL_DEFAULT_TEXTURE_PATH)
+					materials[i]->SetTexPath(1, materials[i]->GetTexPath(2));
 				break;
-			case aiTextureType_SPECULAR: materials[i]->_specularTexPath = _dicPath + str.C_Str();
+			case aiTextureType_SPECULAR: materials[i]->SetTexPath(3, _dicPath + str.C_Str());
 				break;
 		}
 	}
@@ -0,0 +1,58 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+#include "Mesh.h"
+
+namespace ST {
+void RenderQueue::Clear() {
+	_items.clear();
+	_itemShaders.clear();
+	_itemMeshes.clear();
+	_itemModelMats.clear();
+	_shaderRanks.clear();
+	_materialRanks.clear();
+	_meshRanks.clear();
+	_batches.clear();
+	_modelMats.clear();
+}
+
+void RenderQueue::Add(Shader* shader, Mesh* mesh, const glm::mat4& modelMat, float depth) {
+	// A mesh binds all its materials together, the first one stands for the set.
+	const void* material    = mesh->_materials.empty() ? nullptr : mesh->_materials[0].get();
+	const uint64_t stateKey = static_cast<uint64_t>(GetRank(_shaderRanks, shader)) << 48 |
+	                          static_cast<uint64_t>(GetRank(_materialRanks, material)) << 24 |
+	                          GetRank(_meshRanks, mesh);
+	_items.push_back({stateKey, depth, static_cast<uint32_t>(_items.size())});
+	_itemShaders.push_back(shader);
+	_itemMeshes.push_back(mesh);
+	_itemModelMats.push_back(modelMat);
+}
+
+void RenderQueue::Sort() {
+	std::sort(_items.begin(), _items.end(), [](const Item& a, const Item& b) {
+		return a._stateKey != b._stateKey ? a._stateKey < b._stateKey : a._depth < b._depth;
+	});
+
+	_modelMats.reserve(_items.size());
+	for (const auto& item : _items) {
+		if (_batches.empty() || _batches.back()._stateKey != item._stateKey) {
+			_batches.push_back({_itemShaders[item._index], _itemMeshes[item._index],
+				static_cast<uint32_t>(_modelMats.size()), 0, item._stateKey, item._depth});
+		}
+		_modelMats.push_back(_itemModelMats[item._index]);
+		++_batches.back()._instanceCount;
+	}
+
+	// Keeps batches of one shader and material together, nearest first.
+	std::sort(_batches.begin(), _batches.end(), [](const Batch& a, const Batch& b) {
+		const uint64_t aState = a._stateKey >> 24;
+		const uint64_t bState = b._stateKey >> 24;
+		return aState != bState ? aState < bState : a._depth < b._depth;
+	});
+}
+
+uint32_t RenderQueue::GetRank(std::unordered_map<const void*, uint32_t>& ranks, const void* object) {
+	return ranks.try_emplace(object, static_cast<uint32_t>(ranks.size())).first->second;
+}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <unordered_map>
+
+#include "Core.h"
+#include "mat4x4.hpp"
+
+namespace ST {
+class Shader;
+
+class Mesh;
+
+/*
+ * Collects the opaque draws of a frame and orders them to limit state changes and help early depth rejection.
+ *
+ * Items are grouped by shader, then by material, and the items of one mesh inside a material form a batch drawn with
+ * one instanced call. Batches sharing a shader and material are ordered front to back by their nearest item, and the
+ * items of a batch are ordered front to back as well.
+ */
+class RenderQueue {
+public:
+	struct Batch {
+		Shader* _shader;
+
+		Mesh* _mesh;
+
+		// Range of the batch in GetModelMats.
+		uint32_t _firstInstance;
+
+		uint32_t _instanceCount;
+
+		// Shader and material ranks in the high bits, mesh rank in the low bits.
+		uint64_t _stateKey;
+
+		// Depth of the nearest item.
+		float _depth;
+	};
+
+	void Clear();
+
+	// depth is the view space distance of the item, smaller is nearer.
+	void Add(Shader* shader, Mesh* mesh, const glm::mat4& modelMat, float depth);
+
+	// Builds the batches from the items added since Clear.
+	void Sort();
+
+	inline const ST_VECTOR<Batch>& GetBatches() const {
+		return _batches;
+	}
+
+	// Model matrices in batch order, filled by Sort.
+	inline const ST_VECTOR<glm::mat4>& GetModelMats() const {
+		return _modelMats;
+	}
+
+private:
+	struct Item {
+		uint64_t _stateKey;
+
+		float _depth;
+
+		// Index into the per item arrays below.
+		uint32_t _index;
+	};
+
+	// Ranks objects by first appearance since Clear, so equal state gets equal key bits.
+	static uint32_t GetRank(std::unordered_map<const void*, uint32_t>& ranks, const void* object);
+
+	ST_VECTOR<Item> _items;
+
+	ST_VECTOR<Shader*> _itemShaders;
+
+	ST_VECTOR<Mesh*> _itemMeshes;
+
+	ST_VECTOR<glm::mat4> _itemModelMats;
+
+	std::unordered_map<const void*, uint32_t> _shaderRanks;
+
+	std::unordered_map<const void*, uint32_t> _materialRanks;
+
+	std::unordered_map<const void*, uint32_t> _meshRanks;
+
+	ST_VECTOR<Batch> _batches;
+
+	ST_VECTOR<glm::mat4> _modelMats;
+};
+}
@@ -12,6 +12,13 @@
 #include "ext/matrix_transform.hpp"
 #include "UI/Brush.h"
 
+using ST::Shader;
+using ST::UniformId;
+
+static const UniformId V_TRANSFORM_MAT = Shader::GetUniformId("v_TransformMat");
+static const UniformId F_COLOR         = Shader::GetUniformId("f_Color");
+static const UniformId F_TEXTURE       = Shader::GetUniformId("f_Texture");
+
 ST::Renderer2D::Renderer2D(AppWindow* appWindow):
 	_appWindow(appWindow),
 	_vertexArray(ST_MAKE_REF<VertexArray>()),
@@ -74,16 +81,16 @@ void ST::Renderer2D::DrawQuad(const Rect& rect, const Brush& brush) {
 	_vertexArray->_vertexBuffers[0]->Bind();
 	glm::mat4 transformMat = CreateTransformMat(rect);
 	_shader->UseShader();
-	_shader->SetVec4("f_Color", brush._color);
-	_shader->SetMat4("v_TransformMat", transformMat);
+	_shader->SetVec4(F_COLOR, brush._color);
+	_shader->SetMat4(V_TRANSFORM_MAT, transformMat);
 	auto texture=ResourceManager::GetResourceManager().LoadTexture(brush._texPath);
 	if (texture == nullptr) {
 		_texture->Bind(0);
-		_shader->SetInt("f_Texture", 0);
+		_shader->SetInt(F_TEXTURE, 0);
 	}
 	else {
 		texture->Bind(1);
-		_shader->SetInt("f_Texture", 1);
+		_shader->SetInt(F_TEXTURE, 1);
 	}
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 }
@@ -95,19 +102,19 @@ void ST::Renderer2D::DrawSingleLineText(glm::vec2 pos, glm::vec3 color, float sc
 	_textVertexArray->_vertexBuffers[0]->Bind();
 
 	_texShader->UseShader();
-	_texShader->SetVec3("f_Color", color);
+	_texShader->SetVec3(F_COLOR, color);
 
 	for (const auto& ch : text) {
 		auto fontCharacter = _font->GetFontCharacter(ch);
 		fontCharacter->_texture->Bind(3);
-		_texShader->SetInt("f_Texture", 3);
+		_texShader->SetInt(F_TEXTURE, 3);
 		glm::mat4 transformMat = CreateTransformMat(Rect({
 				pos.x + static_cast<float>(fontCharacter->_bearing.x) * scale,
 				pos.y + static_cast<float>(fontCharacter->_bearing.y - fontCharacter->_size.y) * scale
 			},
 			glm::vec2(static_cast<float>(fontCharacter->_size.x) * scale,
 				static_cast<float>(fontCharacter->_size.y) * scale)));
-		_texShader->SetMat4("v_TransformMat", transformMat);
+		_texShader->SetMat4(V_TRANSFORM_MAT, transformMat);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 		pos.x += static_cast<float>(fontCharacter->_advance >> 6) * scale;
 	}
@@ -128,15 +135,15 @@ void ST::Renderer2D::DrawSingleChar(Rect&& rect, ST_FONT_CHAR c) {
 	_textVertexArray->_vertexBuffers[0]->Bind();
 
 	_texShader->UseShader();
-	_texShader->SetVec3("f_Color", glm::vec3(0.1, 0.1, 0.1));
+	_texShader->SetVec3(F_COLOR, glm::vec3(0.1, 0.1, 0.1));
 
 	auto fontCharacter = _font->GetFontCharacter(c);
 	fontCharacter->_texture->Bind(3);
 	fontCharacter->_size;
 	glm::mat4 transformMat = CreateTransformMat(Rect({rect._pos.x, rect._pos.y}, fontCharacter->_size));
-	_texShader->SetMat4("v_TransformMat", transformMat);
+	_texShader->SetMat4(V_TRANSFORM_MAT, transformMat);
 
-	_shader->SetInt("f_Texture", 3);
+	_texShader->SetInt(F_TEXTURE, 3);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 }
 
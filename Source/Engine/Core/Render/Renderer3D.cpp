@@ -1,12 +1,17 @@
 #include "Renderer3D.h"
 
+#include <algorithm>
+
 #include "Camera.h"
 #include "CameraController.h"
+#include "Buffer.h"
 #include "CubeMap.h"
 #include "GameObject.h"
 #include "Mesh.h"
 #include "Model.h"
+#include "UniformBlocks.h"
 #include "Shader.h"
+#include "StaticBatch.h"
 #include "Material.h"
 #include "ResourceManager.h"
 #include "VertexArray.h"
@@ -20,6 +25,17 @@ namespace ST {
 struct Vertex;
 }
 
+using ST::Shader;
+using ST::UniformId;
+
+static const UniformId V_MODEL       = Shader::GetUniformId("v_Model");
+static const UniformId F_COLOR       = Shader::GetUniformId("f_Color");
+static const UniformId F_TEXTURE     = Shader::GetUniformId("f_Texture");
+static const UniformId F_CUBE_MAP    = Shader::GetUniformId("f_cubeMap");
+static const UniformId F_LIGHT_COLOR = Shader::GetUniformId("f_LightColor");
+
+static const ST::MaterialUniforms F_MATERIAL("f_Material");
+
 ST::Renderer3D::Renderer3D(AppWindow* window):
 	_window(window){
 	auto cubeMapShader=ResourceManager::GetResourceManager().LoadShader(
@@ -40,29 +56,49 @@ ST::Renderer3D::Renderer3D(AppWindow* window):
 		"/Resource/OpenGLShader/PureColorShader.fg.glsl");
 	shader->UseShader();
 		_frameBuffer=ST_MAKE_REF<FrameBuffer>(window->_width, _window->_height);
+	_frameConstants = ST_MAKE_REF<UniformBuffer>(sizeof(FrameConstants),
+		static_cast<uint32_t>(UniformBlockBinding::FRAME_CONSTANTS));
+	_lightConstants = ST_MAKE_REF<UniformBuffer>(sizeof(LightConstants),
+		static_cast<uint32_t>(UniformBlockBinding::LIGHT_CONSTANTS));
+	_instanceBuffer = ST_MAKE_REF<VertexBuffer>(nullptr, 0, BufferMode::DYNAMIC_BUFFER);
+	_instanceBuffer->SetLayout(BufferLayout({{Mat4, "v_Model"}}, true));
 	}
 
+void ST::Renderer3D::BeginFrame(ST_REF<Camera> camera) {
+	FrameConstants frameConstants{};
+	frameConstants._viewProj       = camera->GetViewPorjMat();
+	frameConstants._skyBoxViewProj = camera->_projMat * glm::mat4(glm::mat3(camera->_viewMat));
+	frameConstants._eyePos         = camera->_transform._pos;
+	_frameConstants->SetData(&frameConstants, sizeof(frameConstants));
+
+	LightConstants lightConstants{};
+	lightConstants._dirLight._dir         = _dirLight->_dir;
+	lightConstants._dirLight._ia          = _dirLight->_ia;
+	lightConstants._dirLight._id          = _dirLight->_id;
+	lightConstants._dirLight._is          = _dirLight->_is;
+	lightConstants._pointLight._pos       = _pointLight->_pos;
+	lightConstants._pointLight._ia        = _pointLight->_ia;
+	lightConstants._pointLight._id        = _pointLight->_id;
+	lightConstants._pointLight._is        = _pointLight->_is;
+	lightConstants._pointLight._const     = _pointLight->_const;
+	lightConstants._pointLight._linear    = _pointLight->_linear;
+	lightConstants._pointLight._quadratic = _pointLight->_quadratic;
+	_lightConstants->SetData(&lightConstants, sizeof(lightConstants));
+
+	_viewProj = camera->GetViewPorjMat();
+	_culler.SetViewProj(_viewProj);
+	_depthRow = glm::vec4(_viewProj[0][3], _viewProj[1][3], _viewProj[2][3], _viewProj[3][3]);
+	_stats    = Stats{};
+}
+
 void ST::Renderer3D::SetLight() {
-	_shader->SetDirLight("f_DirLight", _dirLight);
-	_shader->SetPointLight("f_PointLight", _pointLight);
 	ImguiPanel::CreateDirLightPanel("Dir Light", _dirLight);
 	ImguiPanel::CreatePointLightPanel("Point Light", _pointLight);
 }
 
-void ST::Renderer3D::BeginDraw(ST_REF<Shader> shader, ST_REF<Camera> camera) {
+void ST::Renderer3D::BeginDraw(ST_REF<Shader> shader) {
 	_shader = shader;
 	_shader->UseShader();
-	_shader->SetMat4("v_ViewProj", camera->GetViewPorjMat());
-	_shader->SetVec3("f_EyePos", camera->_transform._pos);
-
-}
-
-void ST::Renderer3D::BeginDrawSkyBox(ST_REF<Shader> shader, ST_REF<Camera> camera) {
-	_shader = shader;
-	_shader->UseShader();
-	auto viewMat = glm::mat4(glm::mat3(camera->_viewMat));
-	_shader->SetMat4("v_ViewProj", camera->_projMat*viewMat);
-	_shader->SetVec3("f_EyePos", camera->_transform._pos);
 }
 
 void ST::Renderer3D::PostProcessRecordBegin() {
@@ -78,13 +114,9 @@ void ST::Renderer3D::BeginPostProcess() {
 }
 
 void ST::Renderer3D::DrawModel(ST_REF<Model> model, const Transform& transform) {
-	glm::mat4 modelTrans(1.0);
-	modelTrans = scale(modelTrans, transform._scale);
-	modelTrans = mat4_cast(MathLibrary::EulerToQuat(transform._rotator)) * modelTrans;
-	modelTrans = translate(modelTrans, transform._pos);
-	_shader->SetMat4("v_Model", modelTrans);
+	const glm::mat4 modelTrans = transform.GetModelMat();
 	for (auto& mesh : model->_meshes) {
-		DrawMesh(mesh, transform);
+		DrawMeshInstanced(*mesh, &modelTrans, 1);
 	}
 }
 
@@ -94,7 +126,7 @@ void ST::Renderer3D::DrawModelByColor(ST_REF<Model> model, const Transform& tran
 	modelTrans = glm::mat4_cast(MathLibrary::EulerToQuat(transform._rotator)) * modelTrans;
 	modelTrans = glm::scale(modelTrans, transform._scale);
 
-	_shader->SetMat4("v_Model", modelTrans);
+	_shader->SetMat4(V_MODEL, modelTrans);
 	for (auto& mesh : model->_meshes) {
 		DrawMeshByColor(mesh, transform, color);
 	}
@@ -102,11 +134,10 @@ void ST::Renderer3D::DrawModelByColor(ST_REF<Model> model, const Transform& tran
 
 void ST::Renderer3D::DrawMesh(ST_REF<Mesh> mesh, const Transform& transform) {
 	mesh->_vertexArray->Bind();
-	mesh->_vertexArray->_vertexBuffers[0]->Bind();
 
 	for (auto& material : mesh->_materials) {
 		material->Bind();
-		_shader->SetMaterial("f_Material", material);
+		_shader->SetMaterial(F_MATERIAL, *material);
 	}
 
 	if (mesh->_indices.size() > 0) {
@@ -117,11 +148,44 @@ void ST::Renderer3D::DrawMesh(ST_REF<Mesh> mesh, const Transform& transform) {
 	}
 }
 
+void ST::Renderer3D::DrawMeshInstanced(Mesh& mesh, const glm::mat4* modelMats, uint32_t count) {
+	AttachInstanceBuffer(mesh);
+	mesh._vertexArray->Bind();
+
+	for (auto& material : mesh._materials) {
+		material->Bind();
+		_shader->SetMaterial(F_MATERIAL, *material);
+	}
+
+	DrawInstances(mesh, modelMats, count);
+}
+
+bool ST::Renderer3D::AttachInstanceBuffer(Mesh& mesh) {
+	auto& vertexBuffers = mesh._vertexArray->_vertexBuffers;
+	if (std::find(vertexBuffers.begin(), vertexBuffers.end(), _instanceBuffer) != vertexBuffers.end()) {
+		return false;
+	}
+	mesh._vertexArray->AddVertexBuffer(_instanceBuffer);
+	return true;
+}
+
+void ST::Renderer3D::DrawInstances(Mesh& mesh, const glm::mat4* modelMats, uint32_t count) {
+	_instanceBuffer->SetData(modelMats, sizeof(glm::mat4) * count);
+
+	++_stats._drawCalls;
+	_stats._instances += count;
+	if (mesh._indices.size() > 0) {
+		glDrawElementsInstanced(GL_TRIANGLES, mesh._indices.size(),GL_UNSIGNED_INT, 0, count);
+	}
+	else {
+		glDrawArraysInstanced(GL_TRIANGLES, 0, mesh._verts.size(), count);
+	}
+}
+
 void ST::Renderer3D::DrawMeshByColor(ST_REF<Mesh> mesh, const Transform& transform, const glm::vec4& color) {
 	mesh->_vertexArray->Bind();
-	mesh->_vertexArray->_vertexBuffers[0]->Bind();
 
-	_shader->SetVec4("f_Color", color);
+	_shader->SetVec4(F_COLOR, color);
 
 	if (mesh->_indices.size() > 0) {
 		glDrawElements(GL_TRIANGLES, mesh->_indices.size(),GL_UNSIGNED_INT, 0);
@@ -133,9 +197,8 @@ void ST::Renderer3D::DrawMeshByColor(ST_REF<Mesh> mesh, const Transform& transfo
 
 void ST::Renderer3D::DrawQuad(ST_REF<Mesh> mesh) {
 	mesh->_vertexArray->Bind();
-	mesh->_vertexArray->_vertexBuffers[0]->Bind();
 	
-	_shader->SetInt("f_Texture", 0);
+	_shader->SetInt(F_TEXTURE, 0);
 
 	if (mesh->_indices.size() > 0) {
 		glDrawElements(GL_TRIANGLES, mesh->_indices.size(),GL_UNSIGNED_INT, 0);
@@ -147,19 +210,113 @@ void ST::Renderer3D::DrawQuad(ST_REF<Mesh> mesh) {
 
 void ST::Renderer3D::DrawSkyBox(ST_REF<Mesh> mesh) {
 	_skyBox->Bind();
-	_shader->SetInt("f_cubeMap",0);
+	_shader->SetInt(F_CUBE_MAP,0);
 	DrawMesh(mesh,Transform{});
 }
 
 void ST::Renderer3D::DrawLight(ST_REF<Mesh> mesh) {
 	DrawMesh(mesh, Transform{_pointLight->_pos});
-	_shader->SetVec3("f_LightColor", _pointLight->_ia);
+	_shader->SetVec3(F_LIGHT_COLOR, _pointLight->_ia);
 }
 
 void ST::Renderer3D::DrawGameObject(ST_REF<GameObject> gameObject) {
 	DrawModel(gameObject->_model, gameObject->_transform);
 }
 
+void ST::Renderer3D::SubmitGameObject(const GameObject& gameObject) {
+	const glm::mat4 modelTrans = gameObject._transform.GetModelMat();
+	// Scales the radius by the largest axis scale so the sphere still contains the mesh.
+	const float maxScale = glm::sqrt(glm::max(glm::dot(glm::vec3(modelTrans[0]), glm::vec3(modelTrans[0])),
+		glm::max(glm::dot(glm::vec3(modelTrans[1]), glm::vec3(modelTrans[1])),
+			glm::dot(glm::vec3(modelTrans[2]), glm::vec3(modelTrans[2])))));
+	for (auto& mesh : gameObject._model->_meshes) {
+		const glm::vec3 center = glm::vec3(modelTrans * glm::vec4(mesh->_boundsCenter, 1.f));
+		_culler.AddSphere(center, mesh->_boundsRadius * maxScale);
+		_submissions.push_back({_shader.get(), mesh.get(), modelTrans, glm::dot(_depthRow, glm::vec4(center, 1.f))});
+	}
+}
+
+void ST::Renderer3D::FlushGameObjects() {
+	_stats._submittedMeshes += static_cast<uint32_t>(_submissions.size());
+	_stats._culledMeshes += _culler.Cull(_visibility);
+	_renderQueue.Clear();
+	for (size_t i = 0; i < _submissions.size(); ++i) {
+		if (_visibility[i]) {
+			const auto& submission = _submissions[i];
+			_renderQueue.Add(submission._shader, submission._mesh, submission._modelMat, submission._depth);
+		}
+	}
+	_submissions.clear();
+	_culler.Clear();
+	_renderQueue.Sort();
+
+	Shader* boundShader                               = _shader.get();
+	const VertexArray* boundVertexArray               = nullptr;
+	const ST_VECTOR<ST_REF<Material>>* boundMaterials = nullptr;
+	const auto& modelMats                             = _renderQueue.GetModelMats();
+	for (const auto& batch : _renderQueue.GetBatches()) {
+		Mesh& mesh = *batch._mesh;
+		if (AttachInstanceBuffer(mesh)) {
+			boundVertexArray = mesh._vertexArray.get();
+		}
+		if (batch._shader != boundShader) {
+			boundShader = batch._shader;
+			boundShader->UseShader();
+			// Material uniforms belong to the program, set them again for the new one.
+			boundMaterials = nullptr;
+			++_stats._shaderBinds;
+		}
+		if (mesh._vertexArray.get() != boundVertexArray) {
+			boundVertexArray = mesh._vertexArray.get();
+			boundVertexArray->Bind();
+			++_stats._vertexArrayBinds;
+		}
+		if (!boundMaterials || *boundMaterials != mesh._materials) {
+			boundMaterials = &mesh._materials;
+			for (auto& material : mesh._materials) {
+				material->Bind();
+				boundShader->SetMaterial(F_MATERIAL, *material);
+			}
+			++_stats._materialBinds;
+		}
+		DrawInstances(mesh, &modelMats[batch._firstInstance], batch._instanceCount);
+	}
+	if (boundShader != _shader.get()) {
+		_shader->UseShader();
+	}
+}
+
+void ST::Renderer3D::DrawStaticBatch(StaticBatch& batch, const GameObject* hidden) {
+	_stats._culledStaticRanges += batch.Cull(_viewProj, _visibility);
+	const auto& ranges = batch.GetRanges();
+	for (const auto& group : batch.GetGroups()) {
+		_multiDrawCounts.clear();
+		_multiDrawOffsets.clear();
+		_multiDrawBaseVertices.clear();
+		for (uint32_t i = group._firstRange; i < group._firstRange + group._rangeCount; ++i) {
+			if (!_visibility[i] || ranges[i]._gameObject == hidden)
+				continue;
+			_multiDrawCounts.push_back(static_cast<int32_t>(ranges[i]._indexCount));
+			_multiDrawOffsets.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(ranges[i]._indexOffset)));
+			_multiDrawBaseVertices.push_back(ranges[i]._baseVertex);
+		}
+		if (_multiDrawCounts.empty())
+			continue;
+
+		group._vertexArray->Bind();
+		++_stats._vertexArrayBinds;
+		for (auto& material : group._materials) {
+			material->Bind();
+			_shader->SetMaterial(F_MATERIAL, *material);
+		}
+		++_stats._materialBinds;
+		++_stats._drawCalls;
+		_stats._staticRanges += static_cast<uint32_t>(_multiDrawCounts.size());
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, _multiDrawCounts.data(), GL_UNSIGNED_INT, _multiDrawOffsets.data(),
+			static_cast<GLsizei>(_multiDrawCounts.size()), _multiDrawBaseVertices.data());
+	}
+}
+
 void ST::Renderer3D::DrawScaledGameObjectByColor(ST_REF<GameObject> gameObject, const glm::vec3& scale,
 	const glm::vec4& color) {
 	auto& transform = gameObject->_transform;
@@ -1,12 +1,19 @@
 #pragma once
 #include "Core.h"
+#include "FrustumCuller.h"
 #include "Light.h"
+#include "RenderQueue.h"
+#include "mat4x4.hpp"
 
 namespace ST {
 class CubeMap;
 
 class FrameBuffer;
 
+class UniformBuffer;
+
+class VertexBuffer;
+
 class Model;
 
 class Mesh;
@@ -27,10 +34,32 @@ class Shader;
 
 class GameObject;
 
+class StaticBatch;
+
 class Renderer3D {
 public:
+	struct Stats {
+		// Meshes of the objects queued by SubmitGameObject.
+		uint32_t _submittedMeshes{};
+		uint32_t _culledMeshes{};
+		uint32_t _drawCalls{};
+		uint32_t _instances{};
+		// State changes made by FlushGameObjects.
+		uint32_t _shaderBinds{};
+		uint32_t _vertexArrayBinds{};
+		uint32_t _materialBinds{};
+		// Static batch ranges drawn and culled by DrawStaticBatch.
+		uint32_t _staticRanges{};
+		uint32_t _culledStaticRanges{};
+	};
+
 	Renderer3D(AppWindow* window);
 
+	// Uploads the camera and light blocks shared by every program and sets the culling frustum, once per frame
+	// before any draw.
+	void BeginFrame(ST_REF<Camera> camera);
+
+	// Shows the light panels, edits reach the shaders with the next BeginFrame.
 	void SetLight();
 
 	void PostProcessRecordBegin();
@@ -39,14 +68,33 @@ public:
 
 	void BeginPostProcess();
 
-	void BeginDraw(ST_REF<Shader> shader, ST_REF<Camera> camera);
-	
-	void BeginDrawSkyBox(ST_REF<Shader> shader, ST_REF<Camera> camera);
+	void BeginDraw(ST_REF<Shader> shader);
 
 	void DrawLight(ST_REF<Mesh> mesh);
 	
 	void DrawGameObject(ST_REF<GameObject> gameObject);
 
+	// Queues a game object for FlushGameObjects with the current shader. FlushGameObjects culls the queued meshes against
+	// the frustum, sorts the visible ones through the render queue and draws each batch with one instanced draw, binding
+	// only the state that changed since the previous batch.
+	void SubmitGameObject(const GameObject& gameObject);
+
+	void FlushGameObjects();
+
+	// Culls the ranges of the batch and draws the visible ones of each group with one multi draw, skipping the ranges of
+	// hidden.
+	void DrawStaticBatch(StaticBatch& batch, const GameObject* hidden = nullptr);
+
+	// Frustum of the camera passed to BeginFrame.
+	inline const FrustumCuller& GetCuller() const {
+		return _culler;
+	}
+
+	// Counters of the current frame, reset by BeginFrame.
+	inline const Stats& GetStats() const {
+		return _stats;
+	}
+
 	void DrawScaledGameObjectByColor(ST_REF<GameObject> gameObject, const glm::vec3& scale, const glm::vec4& color);
 
 	void DrawQuad(ST_REF<Mesh> mesh);
@@ -61,12 +109,32 @@ public:
 			1.0f, 0.045f, 0.0075f);
 
 private:
+	struct Submission {
+		Shader* _shader;
+
+		Mesh* _mesh;
+
+		glm::mat4 _modelMat;
+
+		// View space depth of the bounding sphere center.
+		float _depth;
+	};
+
 	void DrawModel(ST_REF<Model> model, const Transform& transform);
 
 	void DrawModelByColor(ST_REF<Model> model, const Transform& transform, const glm::vec4& color);
 
 	void DrawMesh(ST_REF<Mesh> mesh, const Transform& transform);
 
+	// Draws count instances of mesh, one per model matrix, with the current shader.
+	void DrawMeshInstanced(Mesh& mesh, const glm::mat4* modelMats, uint32_t count);
+
+	// Adds the instance buffer to the mesh vertex array on first use, which leaves that vertex array bound.
+	bool AttachInstanceBuffer(Mesh& mesh);
+
+	// Uploads the model matrices and issues the draw, the vertex array and materials of mesh must be bound.
+	void DrawInstances(Mesh& mesh, const glm::mat4* modelMats, uint32_t count);
+
 	void DrawMeshByColor(ST_REF<Mesh> mesh, const Transform& transform, const glm::vec4& color);
 
 	AppWindow* _window;
@@ -76,5 +144,35 @@ private:
 	ST_REF<FrameBuffer> _frameBuffer;
 
 	ST_REF<CubeMap> _skyBox;
+
+	ST_REF<UniformBuffer> _frameConstants;
+
+	ST_REF<UniformBuffer> _lightConstants;
+
+	// Per-instance model matrices, respecified for every instanced draw.
+	ST_REF<VertexBuffer> _instanceBuffer;
+
+	// Queued meshes, in the order of their spheres in _culler.
+	ST_VECTOR<Submission> _submissions;
+
+	FrustumCuller _culler;
+
+	ST_VECTOR<uint8_t> _visibility;
+
+	RenderQueue _renderQueue;
+
+	glm::mat4 _viewProj{};
+
+	// Fourth row of the view projection, its dot product with a point is the view space depth.
+	glm::vec4 _depthRow{};
+
+	// Per group arguments of the static batch multi draws.
+	ST_VECTOR<int32_t> _multiDrawCounts;
+
+	ST_VECTOR<const void*> _multiDrawOffsets;
+
+	ST_VECTOR<int32_t> _multiDrawBaseVertices;
+
+	Stats _stats;
 };
 }
@@ -0,0 +1,90 @@
+#include "ResourceReleaseQueue.h"
+
+#include <limits>
+
+namespace ST {
+void ResourceReleaseQueue::Release(GLObjectType type, uint32_t id) {
+	if (!id) {
+		return;
+	}
+	if (!_active) {
+		Delete(type, ST_VECTOR<uint32_t>{id});
+		++_stats._releasedObjects;
+		return;
+	}
+	_pendingReleases.push_back({_frameIndex, type, id});
+	++_stats._pendingObjects;
+}
+
+void ResourceReleaseQueue::BeginFrame() {
+	_active = true;
+	bool retired          = false;
+	uint64_t retiredFrame = 0;
+	while (!_frameFences.empty()) {
+		const GLenum result = glClientWaitSync(_frameFences.front()._fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			break;
+		retired      = true;
+		retiredFrame = _frameFences.front()._frameIndex;
+		glDeleteSync(_frameFences.front()._fence);
+		_frameFences.pop_front();
+	}
+	if (retired) {
+		Free(retiredFrame);
+	}
+}
+
+void ResourceReleaseQueue::EndFrame() {
+	// Fences retire in order, so a frame that released nothing needs none.
+	if (!_pendingReleases.empty() && _pendingReleases.back()._frameIndex == _frameIndex) {
+		_frameFences.push_back({_frameIndex, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+	}
+	++_frameIndex;
+}
+
+void ResourceReleaseQueue::Shutdown() {
+	if (!_frameFences.empty()) {
+		glFinish();
+	}
+	for (auto& frameFence : _frameFences) {
+		glDeleteSync(frameFence._fence);
+	}
+	_frameFences.clear();
+	Free(std::numeric_limits<uint64_t>::max());
+	_active = false;
+}
+
+void ResourceReleaseQueue::Free(uint64_t frameIndex) {
+	while (!_pendingReleases.empty() && _pendingReleases.front()._frameIndex <= frameIndex) {
+		const PendingRelease& release = _pendingReleases.front();
+		_batches[static_cast<int>(release._type)].push_back(release._id);
+		_pendingReleases.pop_front();
+	}
+	for (int type = 0; type < static_cast<int>(GLObjectType::COUNT); ++type) {
+		auto& batch = _batches[type];
+		if (batch.empty())
+			continue;
+		Delete(static_cast<GLObjectType>(type), batch);
+		_stats._pendingObjects -= static_cast<uint32_t>(batch.size());
+		_stats._releasedObjects += batch.size();
+		batch.clear();
+	}
+}
+
+void ResourceReleaseQueue::Delete(GLObjectType type, const ST_VECTOR<uint32_t>& ids) {
+	const GLsizei count = static_cast<GLsizei>(ids.size());
+	switch (type) {
+		case GLObjectType::BUFFER: glDeleteBuffers(count, ids.data());
+			break;
+		case GLObjectType::TEXTURE: glDeleteTextures(count, ids.data());
+			break;
+		case GLObjectType::VERTEX_ARRAY: glDeleteVertexArrays(count, ids.data());
+			break;
+		case GLObjectType::FRAMEBUFFER: glDeleteFramebuffers(count, ids.data());
+			break;
+		case GLObjectType::RENDERBUFFER: glDeleteRenderbuffers(count, ids.data());
+			break;
+		default: break;
+	}
+}
+}
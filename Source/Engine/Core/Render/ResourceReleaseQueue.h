@@ -0,0 +1,87 @@
+#pragma once
+#include <deque>
+
+#include "Core.h"
+
+namespace ST {
+enum class GLObjectType {
+	BUFFER = 0,
+	TEXTURE,
+	VERTEX_ARRAY,
+	FRAMEBUFFER,
+	RENDERBUFFER,
+	COUNT
+};
+
+/*
+ * Defers the deletion of GL objects until the GPU has finished every frame that may still use them.
+ *
+ * Destructors hand their GL names to Release, which tags them with the current frame index. EndFrame puts a fence
+ * behind the frame's commands, and BeginFrame polls the fences without waiting and deletes everything released in
+ * frames that have retired, one glDelete* call per object type. Outside of BeginFrame/Shutdown, e.g. before the first
+ * frame or once the context is going away, objects are deleted immediately.
+ */
+class ResourceReleaseQueue {
+public:
+	struct Stats {
+		uint32_t _pendingObjects{};
+		uint64_t _releasedObjects{};
+	};
+
+	static ResourceReleaseQueue& GetResourceReleaseQueue() {
+		static ResourceReleaseQueue _resourceReleaseQueue;
+
+		return _resourceReleaseQueue;
+	}
+
+	void Release(GLObjectType type, uint32_t id);
+
+	// Frees the objects of retired frames, call at the start of the frame.
+	void BeginFrame();
+
+	// Fences the frame's commands, call after the frame is submitted.
+	void EndFrame();
+
+	// Waits for the GPU and frees everything, must run while the context is still current.
+	void Shutdown();
+
+	inline uint64_t GetFrameIndex() const {
+		return _frameIndex;
+	}
+
+	inline const Stats& GetStats() const {
+		return _stats;
+	}
+
+private:
+	struct PendingRelease {
+		uint64_t _frameIndex{};
+		GLObjectType _type{};
+		uint32_t _id{};
+	};
+
+	struct FrameFence {
+		uint64_t _frameIndex{};
+		GLsync _fence{};
+	};
+
+	ResourceReleaseQueue() = default;
+
+	// Deletes the pending objects released up to and including frameIndex.
+	void Free(uint64_t frameIndex);
+
+	static void Delete(GLObjectType type, const ST_VECTOR<uint32_t>& ids);
+
+	std::deque<PendingRelease> _pendingReleases;
+
+	std::deque<FrameFence> _frameFences;
+
+	ST_VECTOR<uint32_t> _batches[static_cast<int>(GLObjectType::COUNT)];
+
+	uint64_t _frameIndex{};
+
+	bool _active{};
+
+	Stats _stats;
+};
+}
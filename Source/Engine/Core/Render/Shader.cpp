@@ -1,7 +1,13 @@
 #include"Shader.h"
 
+#include <cstring>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
 #include "Light.h"
 #include "Material.h"
+#include "UniformBlocks.h"
 #include "PathManager.h"
 #include "gtc/type_ptr.hpp"
 #include "Resource/ResourceManager.h"
@@ -42,7 +48,7 @@ Shader::Shader(ST_STRING vertShaderPath, ST_STRING fragShaderPath) {
 	glAttachShader(_shaderId, vertShader);
 	glAttachShader(_shaderId, fragShader);
 	glLinkProgram(_shaderId);
-	glGetProgramiv(_shaderId,GL_COMPILE_STATUS, &success);
+	glGetProgramiv(_shaderId,GL_LINK_STATUS, &success);
 	if (!success) {
 		char info[512];
 		glGetProgramInfoLog(_shaderId, 512,NULL, info);
@@ -52,54 +58,142 @@ Shader::Shader(ST_STRING vertShaderPath, ST_STRING fragShaderPath) {
 
 	glDeleteShader(vertShader);
 	glDeleteShader(fragShader);
+	BuildUniformTable();
+	BindUniformBlocks();
 }
 
 ST_REF<Shader> Shader::CreateShader(ST_STRING vertShaderPath, ST_STRING fragShaderPath) {
 	return ST_MAKE_REF<Shader>(vertShaderPath, fragShaderPath);
 }
 
-void Shader::SetInt(ST_STRING propName, int value) const {
-	glUniform1i(glGetUniformLocation(GetShaderId(), propName.c_str()), value);
+UniformId Shader::GetUniformId(const char* name) {
+	// Names are kept in a deque so the views used as keys stay valid.
+	static std::deque<ST_STRING> names;
+	static std::unordered_map<std::string_view, UniformId> ids;
+	auto it = ids.find(name);
+	if (it != ids.end()) {
+		return it->second;
+	}
+	names.emplace_back(name);
+	const UniformId id = static_cast<UniformId>(ids.size());
+	ids.emplace(names.back(), id);
+	return id;
+}
+
+void Shader::BuildUniformTable() {
+	int count = 0, maxLength = 0;
+	glGetProgramiv(_shaderId, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(_shaderId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	ST_VECTOR<char> name(maxLength + 1);
+	for (int i = 0; i < count; ++i) {
+		int length = 0, size = 0;
+		GLenum type;
+		glGetActiveUniform(_shaderId, i, static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+		// Arrays are reported as "name[0]", the setters address their first element by the plain name.
+		if (length > 3 && strcmp(name.data() + length - 3, "[0]") == 0)
+			name[length - 3] = '\0';
+		const int location = glGetUniformLocation(_shaderId, name.data());
+		if (location < 0)
+			continue;
+		const UniformId id = GetUniformId(name.data());
+		if (id >= _uniforms.size())
+			_uniforms.resize(id + 1);
+		_uniforms[id]._location = location;
+	}
+}
+
+void Shader::BindUniformBlocks() {
+	for (uint32_t binding = 0; binding < static_cast<uint32_t>(UniformBlockBinding::COUNT); ++binding) {
+		const unsigned int index = glGetUniformBlockIndex(_shaderId, UNIFORM_BLOCK_NAMES[binding]);
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(_shaderId, index, binding);
+	}
 }
 
-void Shader::SetFloat(ST_STRING propName, float value) const {
-	glUniform1f(glGetUniformLocation(GetShaderId(), propName.c_str()), value);
+int Shader::UpdateUniform(UniformId id, const void* value, size_t size) const {
+	if (id >= _uniforms.size() || _uniforms[id]._location < 0)
+		return -1;
+	Uniform& uniform = _uniforms[id];
+	if (uniform._cached && memcmp(uniform._value, value, size) == 0)
+		return -1;
+	memcpy(uniform._value, value, size);
+	uniform._cached = true;
+	return uniform._location;
 }
 
-void Shader::SetMat4(ST_STRING propName, glm::mat4 mat) const {
-	glUniformMatrix4fv(glGetUniformLocation(GetShaderId(), propName.c_str()), 1,GL_FALSE, glm::value_ptr(mat));
+void Shader::SetInt(UniformId id, int value) const {
+	const int location = UpdateUniform(id, &value, sizeof(value));
+	if (location >= 0)
+		glUniform1i(location, value);
 }
 
-void Shader::SetVec3(ST_STRING propName, glm::vec3 vec) const {
-	glUniform3fv(glGetUniformLocation(GetShaderId(), propName.c_str()), 1, glm::value_ptr(vec));
+void Shader::SetFloat(UniformId id, float value) const {
+	const int location = UpdateUniform(id, &value, sizeof(value));
+	if (location >= 0)
+		glUniform1f(location, value);
 }
 
-void Shader::SetVec4(ST_STRING propName, glm::vec4 vec) const {
-	glUniform4fv(glGetUniformLocation(GetShaderId(), propName.c_str()), 1, glm::value_ptr(vec));
+void Shader::SetMat4(UniformId id, const glm::mat4& mat) const {
+	const int location = UpdateUniform(id, glm::value_ptr(mat), sizeof(mat));
+	if (location >= 0)
+		glUniformMatrix4fv(location, 1,GL_FALSE, glm::value_ptr(mat));
 }
 
-void Shader::SetDirLight(ST_STRING proName, ST_REF<DirLight> light) const {
-	SetVec3(proName + ".f_Dir", light->_dir);
-	SetVec3(proName + ".f_Ia", light->_ia);
-	SetVec3(proName + ".f_Id", light->_id);
-	SetVec3(proName + ".f_Is", light->_is);
+void Shader::SetVec3(UniformId id, const glm::vec3& vec) const {
+	const int location = UpdateUniform(id, glm::value_ptr(vec), sizeof(vec));
+	if (location >= 0)
+		glUniform3fv(location, 1, glm::value_ptr(vec));
 }
 
-void Shader::SetPointLight(ST_STRING proName, ST_REF<PointLight> light) const {
-	SetVec3(proName + ".f_LightPos", light->_pos);
-	SetVec3(proName + ".f_Ia", light->_ia);
-	SetVec3(proName + ".f_Id", light->_id);
-	SetVec3(proName + ".f_Is", light->_is);
-	SetFloat(proName + ".f_Const", light->_const);
-	SetFloat(proName + ".f_Linear", light->_linear);
-	SetFloat(proName + ".f_Quadratic", light->_quadratic);
+void Shader::SetVec4(UniformId id, const glm::vec4& vec) const {
+	const int location = UpdateUniform(id, glm::value_ptr(vec), sizeof(vec));
+	if (location >= 0)
+		glUniform4fv(location, 1, glm::value_ptr(vec));
 }
 
-void Shader::SetMaterial(ST_STRING proName, ST_REF<Material> material) const {
-	int idx = material->_idx * 3;
-	SetInt(proName + ".f_Ka", idx);
-	SetInt(proName + ".f_Kd", idx + 1);
-	SetInt(proName + ".f_Ks", idx + 2);
-	SetFloat(proName + ".f_Shinness", material->_shinness);
+void Shader::SetDirLight(const DirLightUniforms& uniforms, const DirLight& light) const {
+	SetVec3(uniforms._dir, light._dir);
+	SetVec3(uniforms._ia, light._ia);
+	SetVec3(uniforms._id, light._id);
+	SetVec3(uniforms._is, light._is);
 }
+
+void Shader::SetPointLight(const PointLightUniforms& uniforms, const PointLight& light) const {
+	SetVec3(uniforms._pos, light._pos);
+	SetVec3(uniforms._ia, light._ia);
+	SetVec3(uniforms._id, light._id);
+	SetVec3(uniforms._is, light._is);
+	SetFloat(uniforms._const, light._const);
+	SetFloat(uniforms._linear, light._linear);
+	SetFloat(uniforms._quadratic, light._quadratic);
+}
+
+void Shader::SetMaterial(const MaterialUniforms& uniforms, const Material& material) const {
+	int idx = material._idx * 3;
+	SetInt(uniforms._ka, idx);
+	SetInt(uniforms._kd, idx + 1);
+	SetInt(uniforms._ks, idx + 2);
+	SetFloat(uniforms._shinness, material._shinness);
+}
+
+DirLightUniforms::DirLightUniforms(const ST_STRING& name):
+	_dir(Shader::GetUniformId((name + ".f_Dir").c_str())),
+	_ia(Shader::GetUniformId((name + ".f_Ia").c_str())),
+	_id(Shader::GetUniformId((name + ".f_Id").c_str())),
+	_is(Shader::GetUniformId((name + ".f_Is").c_str())) {}
+
+PointLightUniforms::PointLightUniforms(const ST_STRING& name):
+	_pos(Shader::GetUniformId((name + ".f_LightPos").c_str())),
+	_ia(Shader::GetUniformId((name + ".f_Ia").c_str())),
+	_id(Shader::GetUniformId((name + ".f_Id").c_str())),
+	_is(Shader::GetUniformId((name + ".f_Is").c_str())),
+	_const(Shader::GetUniformId((name + ".f_Const").c_str())),
+	_linear(Shader::GetUniformId((name + ".f_Linear").c_str())),
+	_quadratic(Shader::GetUniformId((name + ".f_Quadratic").c_str())) {}
+
+MaterialUniforms::MaterialUniforms(const ST_STRING& name):
+	_ka(Shader::GetUniformId((name + ".f_Ka").c_str())),
+	_kd(Shader::GetUniformId((name + ".f_Kd").c_str())),
+	_ks(Shader::GetUniformId((name + ".f_Ks").c_str())),
+	_shinness(Shader::GetUniformId((name + ".f_Shinness").c_str())) {}
 }
@@ -12,12 +12,37 @@ class PointLight;
 
 class DirLight;
 
+// Interned uniform name, the same name maps to the same id in every Shader.
+using UniformId = uint32_t;
+
+// Lights declared as plain uniforms. Programs reading the LightConstants block get their lights from Renderer3D instead.
+struct DirLightUniforms {
+	explicit DirLightUniforms(const ST_STRING& name);
+
+	UniformId _dir, _ia, _id, _is;
+};
+
+struct PointLightUniforms {
+	explicit PointLightUniforms(const ST_STRING& name);
+
+	UniformId _pos, _ia, _id, _is, _const, _linear, _quadratic;
+};
+
+struct MaterialUniforms {
+	explicit MaterialUniforms(const ST_STRING& name);
+
+	UniformId _ka, _kd, _ks, _shinness;
+};
+
 class Shader {
 public:
 	Shader(ST_STRING vertShaderPath, ST_STRING fragShaderPath);
 
 	static ST_REF<Shader> CreateShader(ST_STRING vertShaderPath, ST_STRING fragShaderPath);
 
+	// Interns a uniform name, intern once and keep the id rather than calling this per draw.
+	static UniformId GetUniformId(const char* name);
+
 	inline void UseShader() const {
 		glUseProgram(_shaderId);
 	}
@@ -26,24 +51,46 @@ public:
 		return _shaderId;
 	}
 
-	void SetInt(ST_STRING propName, int value) const;
+	/*
+	 * The setters upload to the bound program and skip values it already holds. Uniforms the program does not use
+	 * are ignored, like location -1.
+	 */
+	void SetInt(UniformId id, int value) const;
 
-	void SetFloat(ST_STRING propName, float value) const;
+	void SetFloat(UniformId id, float value) const;
 
-	void SetMat4(ST_STRING propName, glm::mat4 mat) const;
+	void SetMat4(UniformId id, const glm::mat4& mat) const;
 
-	void SetVec3(ST_STRING propName, glm::vec3 vec) const;
+	void SetVec3(UniformId id, const glm::vec3& vec) const;
 
-	void SetVec4(ST_STRING propName, glm::vec4 vec) const;
+	void SetVec4(UniformId id, const glm::vec4& vec) const;
 
-	void SetDirLight(ST_STRING proName, ST_REF<DirLight> light) const;
+	void SetDirLight(const DirLightUniforms& uniforms, const DirLight& light) const;
 
-	void SetPointLight(ST_STRING proName,ST_REF<PointLight> light) const;
+	void SetPointLight(const PointLightUniforms& uniforms, const PointLight& light) const;
 
-	void SetMaterial(ST_STRING proName,ST_REF<Material> material) const;
+	void SetMaterial(const MaterialUniforms& uniforms, const Material& material) const;
 
 protected:
+	struct Uniform {
+		int _location = -1;
+		bool _cached  = false;
+		// Last uploaded value, large enough for a mat4.
+		float _value[16];
+	};
+
+	// Indexes the active uniforms of the linked program by UniformId.
+	void BuildUniformTable();
+
+	// Points the shared uniform blocks the program declares at their UniformBlockBinding.
+	void BindUniformBlocks();
+
+	// Returns the location to upload value to, or -1 when the program does not use the uniform or already holds value.
+	int UpdateUniform(UniformId id, const void* value, size_t size) const;
+
 	unsigned int _shaderId;
 
+	mutable ST_VECTOR<Uniform> _uniforms;
+
 };
 }
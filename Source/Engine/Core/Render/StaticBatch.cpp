@@ -0,0 +1,120 @@
+#include "StaticBatch.h"
+
+#include <cfloat>
+
+#include "Buffer.h"
+#include "GameObject.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "Model.h"
+#include "VertexArray.h"
+
+namespace ST {
+namespace {
+struct Source {
+	const GameObject* _gameObject;
+
+	const Mesh* _mesh;
+
+	glm::mat4 _modelMat;
+};
+
+// Meshes can share a group when their materials bind the same textures with the same parameters.
+ST_STRING GetMaterialKey(const ST_VECTOR<ST_REF<Material>>& materials) {
+	ST_STRING key;
+	for (auto& material : materials) {
+		key += material->GetTexPath(1) + '|' + material->GetTexPath(2) + '|' + material->GetTexPath(3) + '|' +
+			std::to_string(material->_shinness) + '|' + std::to_string(material->_idx) + ';';
+	}
+	return key;
+}
+}
+
+StaticBatch::StaticBatch(const ST_VECTOR<ST_REF<GameObject>>& gameObjects) {
+	ST_MAP<ST_STRING, uint32_t> groupIndices;
+	ST_VECTOR<ST_VECTOR<Source>> groupSources;
+	for (auto& gameObject : gameObjects) {
+		if (!gameObject->_static || !gameObject->_model) {
+			continue;
+		}
+		const glm::mat4 modelMat = gameObject->_transform.GetModelMat();
+		for (auto& mesh : gameObject->_model->_meshes) {
+			if (mesh->_verts.empty()) {
+				continue;
+			}
+			auto [it, inserted] = groupIndices.try_emplace(GetMaterialKey(mesh->_materials),
+				static_cast<uint32_t>(_groups.size()));
+			if (inserted) {
+				_groups.push_back({mesh->_materials, nullptr, 0, 0});
+				groupSources.emplace_back();
+			}
+			groupSources[it->second].push_back({gameObject.get(), mesh.get(), modelMat});
+		}
+	}
+
+	const glm::mat4 identity(1.f);
+	_instanceBuffer = ST_MAKE_REF<VertexBuffer>(&identity[0][0], sizeof(identity), BufferMode::STATIC_BUFFER);
+	_instanceBuffer->SetLayout(BufferLayout({{Mat4, "v_Model"}}, true));
+
+	ST_VECTOR<Vertex> verts;
+	ST_VECTOR<unsigned int> indices;
+	for (size_t groupIndex = 0; groupIndex < _groups.size(); ++groupIndex) {
+		Group& group      = _groups[groupIndex];
+		group._firstRange = static_cast<uint32_t>(_ranges.size());
+		group._rangeCount = static_cast<uint32_t>(groupSources[groupIndex].size());
+		verts.clear();
+		indices.clear();
+		for (const auto& source : groupSources[groupIndex]) {
+			const Mesh& mesh          = *source._mesh;
+			const glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(source._modelMat)));
+			const uint32_t baseVertex = static_cast<uint32_t>(verts.size());
+			const uint32_t firstIndex = static_cast<uint32_t>(indices.size());
+			glm::vec3 boundsMin(FLT_MAX);
+			glm::vec3 boundsMax(-FLT_MAX);
+			for (const auto& vert : mesh._verts) {
+				const glm::vec3 pos = glm::vec3(source._modelMat * glm::vec4(vert._pos, 1.f));
+				verts.emplace_back(pos, glm::normalize(normalMat * vert._normal), vert._texCoord);
+				boundsMin = glm::min(boundsMin, pos);
+				boundsMax = glm::max(boundsMax, pos);
+			}
+			if (mesh._indices.empty()) {
+				for (uint32_t i = 0; i < mesh._verts.size(); ++i) {
+					indices.push_back(i);
+				}
+			}
+			else {
+				indices.insert(indices.end(), mesh._indices.begin(), mesh._indices.end());
+			}
+
+			const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+			float radiusSquare     = 0.f;
+			for (uint32_t i = baseVertex; i < verts.size(); ++i) {
+				const glm::vec3 offset = verts[i]._pos - center;
+				radiusSquare           = glm::max(radiusSquare, glm::dot(offset, offset));
+			}
+			_culler.AddSphere(center, glm::sqrt(radiusSquare));
+			_ranges.push_back({source._gameObject, static_cast<uint32_t>(firstIndex * sizeof(unsigned int)),
+				static_cast<uint32_t>(indices.size()) - firstIndex, static_cast<int32_t>(baseVertex)});
+		}
+
+		// The vertex array is created first so the index buffer binds to it.
+		group._vertexArray = ST_MAKE_REF<VertexArray>();
+		auto vertexBuffer  = ST_MAKE_REF<VertexBuffer>((float*)verts.data(), sizeof(Vertex) * verts.size(),
+			BufferMode::STATIC_BUFFER);
+		vertexBuffer->SetLayout({
+			{Float3, "v_Pos"},
+			{Float3, "v_Normal"},
+			{Float2, "v_TexCoord"}
+		});
+		group._vertexArray->AddVertexBuffer(vertexBuffer);
+		group._vertexArray->AddVertexBuffer(_instanceBuffer);
+		group._vertexArray->SetIndexBuffer(ST_MAKE_REF<IndexBuffer>(indices.data(),
+			sizeof(unsigned int) * indices.size()));
+	}
+}
+
+uint32_t StaticBatch::Cull(const glm::mat4& viewProj, ST_VECTOR<uint8_t>& visible) {
+	_culler.SetViewProj(viewProj);
+	return _culler.Cull(visible);
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "Core.h"
+#include "FrustumCuller.h"
+#include "mat4x4.hpp"
+
+namespace ST {
+class GameObject;
+
+class Material;
+
+class VertexArray;
+
+class VertexBuffer;
+
+/*
+ * Merges the meshes of static game objects into shared buffers at load time.
+ *
+ * Meshes whose materials use the same textures share one vertex array, with vertices baked to world space and an
+ * identity model matrix as their only instance. Every source mesh keeps its own index range and base vertex, so the
+ * ranges can be culled one by one and the visible ones of a group drawn with a single glMultiDrawElementsBaseVertex.
+ */
+class StaticBatch {
+public:
+	struct Range {
+		const GameObject* _gameObject;
+
+		// Byte offset of the first index in the group index buffer.
+		uint32_t _indexOffset;
+
+		uint32_t _indexCount;
+
+		int32_t _baseVertex;
+	};
+
+	struct Group {
+		ST_VECTOR<ST_REF<Material>> _materials;
+
+		ST_REF<VertexArray> _vertexArray;
+
+		// Ranges of the group are contiguous in GetRanges.
+		uint32_t _firstRange;
+
+		uint32_t _rangeCount;
+	};
+
+	// Bakes the game objects marked _static, which must not move afterwards.
+	StaticBatch(const ST_VECTOR<ST_REF<GameObject>>& gameObjects);
+
+	// Sets visible[i] for GetRanges()[i] against the frustum of viewProj, returns the number culled.
+	uint32_t Cull(const glm::mat4& viewProj, ST_VECTOR<uint8_t>& visible);
+
+	inline const ST_VECTOR<Group>& GetGroups() const {
+		return _groups;
+	}
+
+	inline const ST_VECTOR<Range>& GetRanges() const {
+		return _ranges;
+	}
+
+private:
+	ST_VECTOR<Group> _groups;
+
+	ST_VECTOR<Range> _ranges;
+
+	// One bounding sphere per range, in range order.
+	FrustumCuller _culler;
+
+	// Identity model matrix shared by the vertex arrays of every group.
+	ST_REF<VertexBuffer> _instanceBuffer;
+};
+}
@@ -1,8 +1,5 @@
 ﻿#include "Texture2D.h"
 
-#include "PathManager.h"
-#include "ResourceManager.h"
-
 namespace ST {
 
 Texture2D::Texture2D(unsigned int width, unsigned int height) {
@@ -25,25 +22,8 @@ Texture2D::Texture2D(ST_STRING imagePath) {
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT);
 
-	int width, height, channel;
-	auto image = ResourceManager::GetResourceManager().LoadImageToCharPtr(PathManager::GetFullPath(imagePath),
-		width, height, channel);
-	if (image) {
-		GLenum format;
-		if (channel == 1)
-			format = GL_RED;
-		else if (channel == 3)
-			format = GL_RGB;
-		else
-			format = GL_RGBA;
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,GL_UNSIGNED_BYTE, image);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		ResourceManager::GetResourceManager().UnloadImage(image);
-	}
-	else {
-		ST_ERROR("Load image failed");
-	}
-
+	_resident = false;
+	TextureUploadQueue::GetTextureUploadQueue().Enqueue(this, imagePath);
 }
 
 Texture2D::Texture2D(unsigned width, unsigned height, unsigned char* buffer) {
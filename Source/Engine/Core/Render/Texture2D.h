@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include"Core.h"
+#include "ResourceReleaseQueue.h"
+#include "TextureUploadQueue.h"
 
 namespace ST {
 class FrameBuffer;
@@ -9,18 +11,28 @@ class Texture2D {
 public:
 	Texture2D(unsigned int width, unsigned int height);
 	friend FrameBuffer;
+	friend TextureUploadQueue;
 	
+	// Decodes and uploads through the TextureUploadQueue, binds a placeholder until the upload completes.
 	Texture2D(ST_STRING imagePath);
 
 	Texture2D(unsigned int width, unsigned int height, unsigned char* buffer);
 
 	inline ~Texture2D() {
-		glDeleteTextures(1, &_textureId);
+		if (_uploadPending)
+			TextureUploadQueue::GetTextureUploadQueue().Cancel(this);
+		ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::TEXTURE, _textureId);
 	}
 
 	inline void Bind(int index) const {
 		glActiveTexture(GL_TEXTURE0 + index);
-		glBindTexture(GL_TEXTURE_2D, _textureId);
+		glBindTexture(GL_TEXTURE_2D, _resident
+		                             ? _textureId
+		                             : TextureUploadQueue::GetTextureUploadQueue().GetPlaceholderTextureId());
+	}
+
+	inline bool IsResident() const {
+		return _resident;
 	}
 
 	inline void UnBind(int index) const {
@@ -30,5 +42,9 @@ public:
 
 private:
 	uint32_t _textureId{};
+
+	bool _resident{true};
+
+	bool _uploadPending{};
 };
 }
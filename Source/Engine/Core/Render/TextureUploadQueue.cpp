@@ -0,0 +1,285 @@
+#include "TextureUploadQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "PathManager.h"
+#include "ResourceManager.h"
+#include "stb_image.h"
+#include "Texture2D.h"
+
+namespace ST {
+
+static GLenum ToGLFormat(int channel) {
+	if (channel == 1)
+		return GL_RED;
+	if (channel == 3)
+		return GL_RGB;
+	return GL_RGBA;
+}
+
+TextureUploadQueue::~TextureUploadQueue() {
+	if (_worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_jobMutex);
+			_quit = true;
+		}
+		_jobCondition.notify_one();
+		_worker.join();
+	}
+}
+
+void TextureUploadQueue::Enqueue(Texture2D* texture, const ST_STRING& imagePath) {
+	if (!_worker.joinable()) {
+		_quit   = false;
+		_worker = std::thread(&TextureUploadQueue::WorkerLoop, this);
+	}
+	auto request        = ST_MAKE_REF<UploadRequest>();
+	request->_texture   = texture;
+	request->_imagePath = imagePath;
+	texture->_uploadPending = true;
+	_requests.push_back(request);
+	++_stats._pendingTextures;
+
+	PostJob([request]() {
+		request->_image = ResourceManager::GetResourceManager().LoadImageToCharPtr(
+			PathManager::GetFullPath(request->_imagePath), request->_width, request->_height, request->_channel);
+		request->_state = UploadState::DECODED;
+	});
+}
+
+void TextureUploadQueue::Cancel(Texture2D* texture) {
+	for (auto& request : _requests) {
+		if (request->_texture == texture) {
+			request->_texture = nullptr;
+		}
+	}
+	texture->_uploadPending = false;
+}
+
+void TextureUploadQueue::Update() {
+	if (_requests.empty()) {
+		return;
+	}
+	// Font sets the alignment to 1 once and relies on it, so the caller's value is restored rather than assumed.
+	GLint previousAlignment = 4;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t budget = _frameBudget;
+	_requests.erase(std::remove_if(_requests.begin(), _requests.end(), [&](const ST_REF<UploadRequest>& request) {
+		return ProcessRequest(*request, budget);
+	}), _requests.end());
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+}
+
+bool TextureUploadQueue::ProcessRequest(UploadRequest& request, size_t& budget) {
+	switch (request._state) {
+		case UploadState::DECODING:
+		case UploadState::COPYING:
+			return false;
+		case UploadState::DECODED: {
+			if (!request._image || !request._texture) {
+				if (!request._image) {
+					ST_LOG("Load image failed! %s\n", request._imagePath.c_str());
+				}
+				else {
+					ResourceManager::GetResourceManager().UnloadImage(request._image);
+				}
+				FinishRequest(request);
+				return true;
+			}
+			const size_t size = static_cast<size_t>(request._width) * request._height * request._channel;
+			request._staging  = AcquireStagingBuffer(size);
+			if (!request._staging) {
+				++_stats._stagingStalls;
+				return false;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request._staging->_bufferId);
+			// The fence of the staging buffer has already signaled, nothing on the GPU still reads it.
+			request._mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (!request._mapped) {
+				ST_LOG("Map staging buffer failed! %s\n", request._imagePath.c_str());
+				ReleaseStagingBuffer(request._staging, false);
+				request._staging = nullptr;
+				return false;
+			}
+			request._state = UploadState::COPYING;
+			UploadRequest* copy = &request;
+			PostJob([copy, size]() {
+				memcpy(copy->_mapped, copy->_image, size);
+				ResourceManager::GetResourceManager().UnloadImage(copy->_image);
+				copy->_image = nullptr;
+				copy->_state = UploadState::COPIED;
+			});
+			return false;
+		}
+		case UploadState::COPIED: {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request._staging->_bufferId);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			request._mapped = nullptr;
+			if (!request._texture) {
+				ReleaseStagingBuffer(request._staging, false);
+				FinishRequest(request);
+				return true;
+			}
+			const GLenum format = ToGLFormat(request._channel);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, request._texture->_textureId);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, request._width, request._height, 0, format, GL_UNSIGNED_BYTE,
+				nullptr);
+			request._state = UploadState::UPLOADING;
+			[[fallthrough]];
+		}
+		case UploadState::UPLOADING: {
+			if (!request._texture) {
+				ReleaseStagingBuffer(request._staging, true);
+				FinishRequest(request);
+				return true;
+			}
+			const size_t rowSize = static_cast<size_t>(request._width) * request._channel;
+			int rows             = static_cast<int>(budget / rowSize);
+			// Keep the first request moving even when a single row exceeds the budget.
+			if (rows == 0 && budget == _frameBudget)
+				rows = 1;
+			rows = std::min(rows, request._height - request._uploadedRows);
+			if (rows == 0) {
+				return false;
+			}
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, request._texture->_textureId);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request._staging->_bufferId);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, request._uploadedRows, request._width, rows,
+				ToGLFormat(request._channel), GL_UNSIGNED_BYTE,
+				reinterpret_cast<void*>(request._uploadedRows * rowSize));
+			request._uploadedRows += rows;
+			budget -= std::min(budget, rows * rowSize);
+			_stats._uploadedBytes += rows * rowSize;
+			if (request._uploadedRows < request._height) {
+				return false;
+			}
+			glGenerateMipmap(GL_TEXTURE_2D);
+			ReleaseStagingBuffer(request._staging, true);
+			request._texture->_resident = true;
+			++_stats._residentTextures;
+			FinishRequest(request);
+			return true;
+		}
+	}
+	return false;
+}
+
+void TextureUploadQueue::FinishRequest(UploadRequest& request) {
+	if (request._texture) {
+		request._texture->_uploadPending = false;
+	}
+	request._texture = nullptr;
+	request._staging = nullptr;
+	--_stats._pendingTextures;
+}
+
+TextureUploadQueue::StagingBuffer* TextureUploadQueue::AcquireStagingBuffer(size_t size) {
+	StagingBuffer* smaller = nullptr;
+	for (auto& staging : _stagingBuffers) {
+		if (staging._inUse)
+			continue;
+		if (staging._fence) {
+			if (glClientWaitSync(staging._fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				continue;
+			glDeleteSync(staging._fence);
+			staging._fence = nullptr;
+		}
+		if (staging._size >= size) {
+			staging._inUse = true;
+			return &staging;
+		}
+		if (!smaller)
+			smaller = &staging;
+	}
+	if (!smaller) {
+		return nullptr;
+	}
+	if (!smaller->_bufferId)
+		glGenBuffers(1, &smaller->_bufferId);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, smaller->_bufferId);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	smaller->_size  = size;
+	smaller->_inUse = true;
+	return smaller;
+}
+
+void TextureUploadQueue::ReleaseStagingBuffer(StagingBuffer* staging, bool fence) {
+	if (fence)
+		staging->_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	staging->_inUse = false;
+}
+
+uint32_t TextureUploadQueue::GetPlaceholderTextureId() {
+	if (!_placeholderTextureId) {
+		const unsigned char white[4] = {255, 255, 255, 255};
+		glGenTextures(1, &_placeholderTextureId);
+		glBindTexture(GL_TEXTURE_2D, _placeholderTextureId);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA,GL_UNSIGNED_BYTE, white);
+	}
+	return _placeholderTextureId;
+}
+
+void TextureUploadQueue::Shutdown() {
+	if (_worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_jobMutex);
+			_quit = true;
+			_jobs.clear();
+		}
+		_jobCondition.notify_one();
+		_worker.join();
+	}
+	for (auto& request : _requests) {
+		if (request->_image)
+			ResourceManager::GetResourceManager().UnloadImage(request->_image);
+		FinishRequest(*request);
+	}
+	_requests.clear();
+	for (auto& staging : _stagingBuffers) {
+		if (staging._fence)
+			glDeleteSync(staging._fence);
+		if (staging._bufferId)
+			glDeleteBuffers(1, &staging._bufferId);
+		staging = StagingBuffer{};
+	}
+	if (_placeholderTextureId) {
+		glDeleteTextures(1, &_placeholderTextureId);
+		_placeholderTextureId = 0;
+	}
+}
+
+void TextureUploadQueue::PostJob(ST_FUNC<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(_jobMutex);
+		_jobs.push_back(std::move(job));
+	}
+	_jobCondition.notify_one();
+}
+
+void TextureUploadQueue::WorkerLoop() {
+	// The flip flag is global by default and CubeMap toggles it on the render thread.
+	stbi_set_flip_vertically_on_load_thread(true);
+	while (true) {
+		ST_FUNC<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_jobMutex);
+			_jobCondition.wait(lock, [this]() {
+				return _quit || !_jobs.empty();
+			});
+			if (_quit)
+				return;
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "Core.h"
+
+namespace ST {
+class Texture2D;
+
+/*
+ * Streams image files into textures without stalling the render thread.
+ *
+ * Images are decoded on a worker thread, which also copies the pixels into a mapped staging PBO. Update, called once
+ * per frame on the render thread, moves every request one step further and uploads rows from the staging buffers
+ * with glTexSubImage2D until the frame budget is spent, so a large texture is spread over several frames. Until its
+ * last row lands and its mips are generated, a texture binds a 1x1 white placeholder.
+ */
+class TextureUploadQueue {
+public:
+	struct Stats {
+		uint32_t _pendingTextures{};
+		uint32_t _residentTextures{};
+		uint64_t _uploadedBytes{};
+		// Frames a decoded image waited because every staging buffer was busy.
+		uint32_t _stagingStalls{};
+	};
+
+	static TextureUploadQueue& GetTextureUploadQueue() {
+		static TextureUploadQueue _textureUploadQueue;
+
+		return _textureUploadQueue;
+	}
+
+	~TextureUploadQueue();
+
+	// texture must have its GL name generated and keeps binding the placeholder until the upload completes.
+	void Enqueue(Texture2D* texture, const ST_STRING& imagePath);
+
+	// Drops the pending upload of a texture being destroyed.
+	void Cancel(Texture2D* texture);
+
+	void Update();
+
+	// Joins the worker and releases the GL objects, must run while the context is still current.
+	void Shutdown();
+
+	uint32_t GetPlaceholderTextureId();
+
+	inline void SetFrameBudget(size_t bytes) {
+		_frameBudget = bytes;
+	}
+
+	inline const Stats& GetStats() const {
+		return _stats;
+	}
+
+private:
+	enum class UploadState {
+		DECODING = 0,
+		DECODED,
+		COPYING,
+		COPIED,
+		UPLOADING
+	};
+
+	struct StagingBuffer {
+		uint32_t _bufferId{};
+		size_t _size{};
+		// Signaled once the GPU has read the last upload sourced from this buffer.
+		GLsync _fence{};
+		bool _inUse{};
+	};
+
+	struct UploadRequest {
+		Texture2D* _texture{};
+		ST_STRING _imagePath;
+		std::atomic<UploadState> _state{UploadState::DECODING};
+		unsigned char* _image{};
+		int _width{};
+		int _height{};
+		int _channel{};
+		StagingBuffer* _staging{};
+		void* _mapped{};
+		int _uploadedRows{};
+	};
+
+	TextureUploadQueue() = default;
+
+	void WorkerLoop();
+
+	void PostJob(ST_FUNC<void()> job);
+
+	StagingBuffer* AcquireStagingBuffer(size_t size);
+
+	void ReleaseStagingBuffer(StagingBuffer* staging, bool fence);
+
+	// Returns true once the request is finished and can be dropped.
+	bool ProcessRequest(UploadRequest& request, size_t& budget);
+
+	void FinishRequest(UploadRequest& request);
+
+	static constexpr int STAGING_BUFFER_COUNT = 4;
+
+	static constexpr size_t DEFAULT_FRAME_BUDGET = 4 * 1024 * 1024;
+
+	ST_VECTOR<ST_REF<UploadRequest>> _requests;
+
+	StagingBuffer _stagingBuffers[STAGING_BUFFER_COUNT];
+
+	uint32_t _placeholderTextureId{};
+
+	size_t _frameBudget{DEFAULT_FRAME_BUDGET};
+
+	Stats _stats;
+
+	std::thread _worker;
+
+	std::deque<ST_FUNC<void()>> _jobs;
+
+	std::mutex _jobMutex;
+
+	std::condition_variable _jobCondition;
+
+	bool _quit{};
+};
+}
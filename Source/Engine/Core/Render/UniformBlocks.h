@@ -0,0 +1,62 @@
+#pragma once
+#include "glm.hpp"
+
+namespace ST {
+/*
+ * Uniform blocks shared by every program, bound once per frame at fixed binding points. The structs mirror the std140
+ * layout of the blocks in Resource/OpenGLShader, each vec3 takes a 16 byte slot unless a float follows it.
+ */
+enum class UniformBlockBinding : uint32_t {
+	FRAME_CONSTANTS = 0,
+	LIGHT_CONSTANTS,
+	COUNT
+};
+
+// Block names in the shaders, indexed by UniformBlockBinding.
+inline constexpr const char* UNIFORM_BLOCK_NAMES[] = {"FrameConstants", "LightConstants"};
+
+struct FrameConstants {
+	glm::mat4 _viewProj;
+
+	// View without translation, the sky box stays centered on the eye.
+	glm::mat4 _skyBoxViewProj;
+
+	glm::vec3 _eyePos;
+
+	float _pad0;
+};
+
+struct LightConstants {
+	struct DirLightBlock {
+		glm::vec3 _dir;
+		float _pad0;
+		glm::vec3 _ia;
+		float _pad1;
+		glm::vec3 _id;
+		float _pad2;
+		glm::vec3 _is;
+		float _pad3;
+	};
+
+	struct PointLightBlock {
+		glm::vec3 _pos;
+		float _pad0;
+		glm::vec3 _ia;
+		float _pad1;
+		glm::vec3 _id;
+		float _pad2;
+		glm::vec3 _is;
+		float _const;
+		float _linear;
+		float _quadratic;
+		float _pad3[2];
+	};
+
+	DirLightBlock _dirLight;
+
+	PointLightBlock _pointLight;
+};
+
+static_assert(sizeof(FrameConstants) == 144, "FrameConstants must match the std140 block");
+static_assert(sizeof(LightConstants) == 144, "LightConstants must match the std140 block");
+}
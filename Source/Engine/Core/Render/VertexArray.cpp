@@ -20,20 +20,27 @@ namespace ST
         {
             stride+=GetShaderDataTypeSize(element._type);
         }
-        int index=0;
+        const bool perInstance=vertexBuffer->GetBufferLayout()._perInstance;
         int offset=0;
         for(auto& element : vertexBuffer->GetBufferLayout())
         {
-            glVertexAttribPointer(
-                index,
-                GetShaderDataTypeCount(element._type),
-                ShaderDataType2GLType(element._type),
-                element.normalized? GL_TRUE:GL_FALSE,
-                stride,
-                (void*)offset);
-            glEnableVertexAttribArray(index);
-            offset+=GetShaderDataTypeSize(element._type);
-            ++index;
+            // Matrices take one location per column.
+            const int columns=element._type==Mat4? 4 : element._type==Mat3? 3 : 1;
+            const int columnSize=GetShaderDataTypeSize(element._type)/columns;
+            for(int column=0;column<columns;++column)
+            {
+                glVertexAttribPointer(
+                    _attributeCount,
+                    GetShaderDataTypeCount(element._type)/columns,
+                    ShaderDataType2GLType(element._type),
+                    element.normalized? GL_TRUE:GL_FALSE,
+                    stride,
+                    (void*)(intptr_t)offset);
+                glEnableVertexAttribArray(_attributeCount);
+                glVertexAttribDivisor(_attributeCount,perInstance? 1 : 0);
+                offset+=columnSize;
+                ++_attributeCount;
+            }
         }
     }
 
@@ -2,6 +2,7 @@
 
 #include "Buffer.h"
 #include "Core.h"
+#include "ResourceReleaseQueue.h"
 
 namespace ST {
 class VertexBuffer;
@@ -14,7 +15,7 @@ public:
 	VertexArray();
 
 	~VertexArray() {
-		glDeleteVertexArrays(1, &_arraryId);
+		ResourceReleaseQueue::GetResourceReleaseQueue().Release(GLObjectType::VERTEX_ARRAY, _arraryId);
 	}
 
 	inline void Bind() const {
@@ -36,5 +37,8 @@ public:
 private:
 	unsigned int _arraryId;
 
+	// Attribute locations used by the buffers added so far, the next buffer starts after them.
+	unsigned int _attributeCount = 0;
+
 };
 }
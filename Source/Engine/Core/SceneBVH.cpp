@@ -0,0 +1,303 @@
+#include "SceneBVH.h"
+
+namespace ST {
+int32_t SceneBVH::Insert(GameObject* gameObject, const AABB& bounds) {
+	const int32_t leaf       = AllocateNode();
+	_nodes[leaf]._box        = bounds.Expanded(FAT_MARGIN);
+	_nodes[leaf]._bounds     = bounds;
+	_nodes[leaf]._gameObject = gameObject;
+	_nodes[leaf]._height     = 0;
+	InsertLeaf(leaf);
+	++_objectCount;
+	return leaf;
+}
+
+void SceneBVH::Remove(int32_t proxy) {
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	--_objectCount;
+}
+
+bool SceneBVH::Update(int32_t proxy, const AABB& bounds) {
+	Node& leaf   = _nodes[proxy];
+	leaf._bounds = bounds;
+	if (leaf._box.Contains(bounds)) {
+		return false;
+	}
+	const glm::vec3 center = bounds.GetCenter();
+	if (leaf._box.Contains(AABB(center, center))) {
+		leaf._box = bounds.Expanded(FAT_MARGIN);
+		FixUpwards(leaf._parent);
+		return false;
+	}
+	RemoveLeaf(proxy);
+	_nodes[proxy]._box = bounds.Expanded(FAT_MARGIN);
+	InsertLeaf(proxy);
+	return true;
+}
+
+void SceneBVH::QueryFrustum(const glm::vec4* planes, const ST_FUNC<void(GameObject*)>& func) const {
+	if (_root == NULL_NODE) {
+		return;
+	}
+	_stack.clear();
+	_stack.push_back(_root);
+	while (!_stack.empty()) {
+		const int32_t index = _stack.back();
+		_stack.pop_back();
+		const Node& node        = _nodes[index];
+		const glm::vec3 center  = node._box.GetCenter();
+		const glm::vec3 extents = node._box.GetExtents();
+		bool outside            = false;
+		bool inside             = true;
+		for (int i = 0; i < 6 && !outside; ++i) {
+			const glm::vec3 normal = glm::vec3(planes[i]);
+			const float distance   = glm::dot(normal, center) + planes[i].w;
+			const float radius     = glm::dot(glm::abs(normal), extents);
+			outside                = distance + radius < 0.f;
+			inside                 = inside && distance - radius >= 0.f;
+		}
+		if (outside) {
+			continue;
+		}
+		if (node.IsLeaf()) {
+			func(node._gameObject);
+			continue;
+		}
+		if (!inside) {
+			_stack.push_back(node._child1);
+			_stack.push_back(node._child2);
+			continue;
+		}
+		// The whole subtree is visible, report its leaves without testing the planes again.
+		const size_t base = _stack.size();
+		_stack.push_back(index);
+		while (_stack.size() > base) {
+			const Node& child = _nodes[_stack.back()];
+			_stack.pop_back();
+			if (child.IsLeaf()) {
+				func(child._gameObject);
+			}
+			else {
+				_stack.push_back(child._child1);
+				_stack.push_back(child._child2);
+			}
+		}
+	}
+}
+
+GameObject* SceneBVH::RayCast(const glm::vec3& origin, const glm::vec3& dir, float maxT,
+	const ST_FUNC<float(GameObject*, float)>& func, float& hitT) const {
+	if (_root == NULL_NODE) {
+		return nullptr;
+	}
+	const glm::vec3 invDir = 1.f / dir;
+	GameObject* closest    = nullptr;
+	float closestT         = maxT;
+	_stack.clear();
+	_stack.push_back(_root);
+	while (!_stack.empty()) {
+		const Node& node = _nodes[_stack.back()];
+		_stack.pop_back();
+		// Boxes are tested again after popping since closer hits may have been found meanwhile.
+		if (node._box.RayIntersect(origin, invDir, closestT) < 0.f) {
+			continue;
+		}
+		if (node.IsLeaf()) {
+			const float t = func(node._gameObject, closestT);
+			if (t >= 0.f && t < closestT) {
+				closestT = t;
+				closest  = node._gameObject;
+			}
+			continue;
+		}
+		const float t1 = _nodes[node._child1]._box.RayIntersect(origin, invDir, closestT);
+		const float t2 = _nodes[node._child2]._box.RayIntersect(origin, invDir, closestT);
+		// Visit the nearer child first, its hits prune the farther one.
+		const bool firstIsNearer = t2 < 0.f || (t1 >= 0.f && t1 <= t2);
+		const int32_t nearer     = firstIsNearer ? node._child1 : node._child2;
+		const int32_t farther    = firstIsNearer ? node._child2 : node._child1;
+		if ((firstIsNearer ? t2 : t1) >= 0.f)
+			_stack.push_back(farther);
+		if ((firstIsNearer ? t1 : t2) >= 0.f)
+			_stack.push_back(nearer);
+	}
+	if (closest) {
+		hitT = closestT;
+	}
+	return closest;
+}
+
+int32_t SceneBVH::AllocateNode() {
+	if (_freeList == NULL_NODE) {
+		_nodes.emplace_back();
+		return static_cast<int32_t>(_nodes.size() - 1);
+	}
+	const int32_t node = _freeList;
+	_freeList          = _nodes[node]._parent;
+	_nodes[node]       = Node{};
+	return node;
+}
+
+void SceneBVH::FreeNode(int32_t node) {
+	_nodes[node]         = Node{};
+	_nodes[node]._parent = _freeList;
+	_freeList            = node;
+}
+
+void SceneBVH::InsertLeaf(int32_t leaf) {
+	if (_root == NULL_NODE) {
+		_root                = leaf;
+		_nodes[leaf]._parent = NULL_NODE;
+		return;
+	}
+
+	// Descend towards the sibling whose merge with the leaf adds the least surface area to the tree.
+	const AABB leafBox = _nodes[leaf]._box;
+	int32_t index      = _root;
+	while (!_nodes[index].IsLeaf()) {
+		const Node& node = _nodes[index];
+		AABB combined    = node._box;
+		combined.Merge(leafBox);
+		const float combinedArea = combined.GetArea();
+		// Cost of making a new parent for this node and the leaf, and the cost pushed down into the children.
+		const float cost            = 2.f * combinedArea;
+		const float inheritanceCost = 2.f * (combinedArea - node._box.GetArea());
+		float childCosts[2];
+		const int32_t children[2] = {node._child1, node._child2};
+		for (int i = 0; i < 2; ++i) {
+			const Node& child = _nodes[children[i]];
+			AABB merged       = child._box;
+			merged.Merge(leafBox);
+			childCosts[i] = child.IsLeaf()
+			                ? merged.GetArea() + inheritanceCost
+			                : merged.GetArea() - child._box.GetArea() + inheritanceCost;
+		}
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	const int32_t sibling   = index;
+	const int32_t oldParent = _nodes[sibling]._parent;
+	const int32_t newParent = AllocateNode();
+	Node& parent            = _nodes[newParent];
+	parent._parent          = oldParent;
+	parent._box             = leafBox;
+	parent._box.Merge(_nodes[sibling]._box);
+	parent._height = _nodes[sibling]._height + 1;
+	parent._child1 = sibling;
+	parent._child2 = leaf;
+	if (oldParent != NULL_NODE) {
+		if (_nodes[oldParent]._child1 == sibling)
+			_nodes[oldParent]._child1 = newParent;
+		else
+			_nodes[oldParent]._child2 = newParent;
+	}
+	else {
+		_root = newParent;
+	}
+	_nodes[sibling]._parent = newParent;
+	_nodes[leaf]._parent    = newParent;
+
+	FixUpwards(oldParent);
+}
+
+void SceneBVH::RemoveLeaf(int32_t leaf) {
+	if (leaf == _root) {
+		_root = NULL_NODE;
+		return;
+	}
+	const int32_t parent      = _nodes[leaf]._parent;
+	const int32_t grandParent = _nodes[parent]._parent;
+	const int32_t sibling     = _nodes[parent]._child1 == leaf ? _nodes[parent]._child2 : _nodes[parent]._child1;
+	_nodes[leaf]._parent      = NULL_NODE;
+	if (grandParent != NULL_NODE) {
+		if (_nodes[grandParent]._child1 == parent)
+			_nodes[grandParent]._child1 = sibling;
+		else
+			_nodes[grandParent]._child2 = sibling;
+		_nodes[sibling]._parent = grandParent;
+		FreeNode(parent);
+		FixUpwards(grandParent);
+	}
+	else {
+		_root                   = sibling;
+		_nodes[sibling]._parent = NULL_NODE;
+		FreeNode(parent);
+	}
+}
+
+void SceneBVH::FixUpwards(int32_t node) {
+	while (node != NULL_NODE) {
+		node               = Balance(node);
+		Node& current      = _nodes[node];
+		const Node& child1 = _nodes[current._child1];
+		const Node& child2 = _nodes[current._child2];
+		current._height    = 1 + glm::max(child1._height, child2._height);
+		current._box       = child1._box;
+		current._box.Merge(child2._box);
+		node = current._parent;
+	}
+}
+
+int32_t SceneBVH::Balance(int32_t iA) {
+	Node& A = _nodes[iA];
+	if (A.IsLeaf() || A._height < 2) {
+		return iA;
+	}
+	const int32_t iB = A._child1;
+	const int32_t iC = A._child2;
+	Node& B          = _nodes[iB];
+	Node& C          = _nodes[iC];
+	const int32_t balance = C._height - B._height;
+
+	// Rotates the taller child up to replace A, A keeps the shorter grandchild.
+	const auto rotateUp = [&](int32_t iUp, Node& up, Node& other, bool upIsChild2) {
+		const int32_t iF = up._child1;
+		const int32_t iG = up._child2;
+		Node& F          = _nodes[iF];
+		Node& G          = _nodes[iG];
+
+		up._child1 = iA;
+		up._parent = A._parent;
+		A._parent  = iUp;
+		if (up._parent != NULL_NODE) {
+			if (_nodes[up._parent]._child1 == iA)
+				_nodes[up._parent]._child1 = iUp;
+			else
+				_nodes[up._parent]._child2 = iUp;
+		}
+		else {
+			_root = iUp;
+		}
+
+		const bool keepF     = F._height > G._height;
+		const int32_t iKept  = keepF ? iF : iG;
+		const int32_t iMoved = keepF ? iG : iF;
+		Node& kept           = keepF ? F : G;
+		Node& moved          = keepF ? G : F;
+		up._child2           = iKept;
+		if (upIsChild2)
+			A._child2 = iMoved;
+		else
+			A._child1 = iMoved;
+		moved._parent = iA;
+		A._box        = other._box;
+		A._box.Merge(moved._box);
+		up._box = A._box;
+		up._box.Merge(kept._box);
+		A._height  = 1 + glm::max(other._height, moved._height);
+		up._height = 1 + glm::max(A._height, kept._height);
+		return iUp;
+	};
+
+	if (balance > 1) {
+		return rotateUp(iC, C, B, true);
+	}
+	if (balance < -1) {
+		return rotateUp(iB, B, C, false);
+	}
+	return iA;
+}
+}
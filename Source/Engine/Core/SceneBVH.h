@@ -0,0 +1,105 @@
+#pragma once
+#include "Core.h"
+#include "Math/AABB.h"
+
+namespace ST {
+class GameObject;
+
+/*
+ * Dynamic bounding volume hierarchy over the world space bounds of game objects.
+ *
+ * Leaves store their bounds grown by a margin, so small moves only refit the path to the root and objects that leave
+ * their fattened box are removed and reinserted. Inserts pick the sibling with the smallest surface area increase and
+ * every change rebalances the path with AVL rotations, which keeps the tree height, and the cost of frustum and ray
+ * queries, logarithmic in the number of objects.
+ */
+class SceneBVH {
+public:
+	static constexpr int32_t NULL_NODE = -1;
+
+	// Returns the proxy id of the object, pass it to Update and Remove.
+	int32_t Insert(GameObject* gameObject, const AABB& bounds);
+
+	void Remove(int32_t proxy);
+
+	// Keeps the leaf while its fattened box contains bounds, refits the path to the root when the object moved by less
+	// than its box and reinserts it otherwise. Returns true on reinsert.
+	bool Update(int32_t proxy, const AABB& bounds);
+
+	// Calls func(gameObject) for every object whose fattened bounds intersect the frustum, planes as FrustumCuller uses
+	// them.
+	void QueryFrustum(const glm::vec4* planes, const ST_FUNC<void(GameObject*)>& func) const;
+
+	/*
+	 * Returns the closest object hit by the ray and writes its distance along dir to hitT. func(gameObject, maxT)
+	 * returns the exact hit distance of an object whose bounds the ray crosses, or a negative value for a miss, and
+	 * only objects that may be closer than the best hit so far are passed to it.
+	 */
+	GameObject* RayCast(const glm::vec3& origin, const glm::vec3& dir, float maxT,
+		const ST_FUNC<float(GameObject*, float)>& func, float& hitT) const;
+
+	inline const AABB& GetBounds(int32_t proxy) const {
+		return _nodes[proxy]._bounds;
+	}
+
+	inline int32_t GetHeight() const {
+		return _root == NULL_NODE ? 0 : _nodes[_root]._height;
+	}
+
+	inline uint32_t GetObjectCount() const {
+		return _objectCount;
+	}
+
+private:
+	struct Node {
+		// Fattened for leaves, the union of the children otherwise.
+		AABB _box;
+
+		// Exact bounds of the object, leaves only.
+		AABB _bounds;
+
+		GameObject* _gameObject{};
+
+		// Next free node while the node is unused.
+		int32_t _parent = NULL_NODE;
+
+		int32_t _child1 = NULL_NODE;
+
+		int32_t _child2 = NULL_NODE;
+
+		// Leaves are 0, free nodes -1.
+		int32_t _height = -1;
+
+		inline bool IsLeaf() const {
+			return _child1 == NULL_NODE;
+		}
+	};
+
+	static constexpr float FAT_MARGIN = 0.1f;
+
+	int32_t AllocateNode();
+
+	void FreeNode(int32_t node);
+
+	void InsertLeaf(int32_t leaf);
+
+	void RemoveLeaf(int32_t leaf);
+
+	// Recomputes boxes and heights from node to the root, rotating unbalanced nodes on the way.
+	void FixUpwards(int32_t node);
+
+	// Rotates node A when its children heights differ by more than one, returns the new root of the subtree.
+	int32_t Balance(int32_t iA);
+
+	ST_VECTOR<Node> _nodes;
+
+	int32_t _root = NULL_NODE;
+
+	int32_t _freeList = NULL_NODE;
+
+	uint32_t _objectCount = 0;
+
+	// Traversal stack shared by the queries.
+	mutable ST_VECTOR<int32_t> _stack;
+};
+}
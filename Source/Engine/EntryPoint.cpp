@@ -5,6 +5,7 @@ extern Application* CreateApplication();
 
 int main(int argc, char* argv[]){
     Application* app = CreateApplication();
+    app->SetArguments(argc, argv);
     app->Init();
     float cachedTime = 0;
     bool  hasCached  = false;
@@ -0,0 +1,251 @@
+#include "FrameCapture.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "Serlalizer/Serializer.h"
+
+namespace graphics
+{
+enum class RecordHandle
+{
+	kRenderPass, kPipeline, kResourceList, kBuffer
+};
+
+//
+// Calls func(handle, kind) on every resource handle held by the packed records, which func may rewrite.
+//
+template <typename Func>
+static void ForEachRecordHandle(std::vector<uint8_t>& records, Func&& func)
+{
+	for (size_t offset = 0; offset < records.size();)
+	{
+		CommandHeader& header = *reinterpret_cast<CommandHeader*>(records.data() + offset);
+		switch (header.type_)
+		{
+			case CommandType::BeginPass: func(reinterpret_cast<BeginPassCommand&>(header).handle_, RecordHandle::kRenderPass); break;
+			case CommandType::BindPipeline: func(reinterpret_cast<BindPipelineCommand&>(header).handle_, RecordHandle::kPipeline); break;
+			case CommandType::BindResourceList:
+			{
+				BindResourceListCommand& command = reinterpret_cast<BindResourceListCommand&>(header);
+				for (uint32_t i = 0; i < command.num_lists_; ++i) { func(command.handles_[i], RecordHandle::kResourceList); }
+				break;
+			}
+			case CommandType::BindVertexBuffer: func(reinterpret_cast<BindVertexBufferCommand&>(header).buffer_handle_, RecordHandle::kBuffer); break;
+			case CommandType::BindIndexBuffer: func(reinterpret_cast<BindIndexBufferCommand&>(header).buffer_handle_, RecordHandle::kBuffer); break;
+			// Both indirect records share their layout.
+			case CommandType::DrawIndirect:
+			case CommandType::DrawIndexedIndirect: func(reinterpret_cast<DrawIndirectCommand&>(header).buffer_handle_, RecordHandle::kBuffer); break;
+			default: break;
+		}
+		offset += header.size_;
+	}
+}
+
+static ResourceHandle Remap(const std::unordered_map<ResourceHandle, ResourceHandle>& map, ResourceHandle handle)
+{
+	const auto found = map.find(handle);
+	return found != map.end()
+	       ? found->second
+	       : kInvalidHandle;
+}
+
+static bool IsTextureBinding(ResourceType type) { return type == ResourceType::kTexture || type == ResourceType::kTextureRW; }
+
+static bool IsBufferBinding(ResourceType type)
+{
+	return type == ResourceType::kConstants || type == ResourceType::kBuffer || type == ResourceType::kBufferRW;
+}
+
+void FrameCapture::Capture(Device& device, const std::vector<uint8_t>& records)
+{
+	*this = FrameCapture();
+	records_ = records;
+
+	std::unordered_set<ResourceHandle> captured_passes, captured_textures, captured_buffers, captured_samplers, captured_lists, captured_pipelines;
+	const auto capture_texture = [&](ResourceHandle handle)
+	{
+		if (!device.textures_.IsValid(handle) || !captured_textures.insert(handle).second) { return; }
+		const Texture* texture = device.textures_.AccessResource(handle);
+		textures_.push_back({handle, texture->width_, texture->height_, texture->format_});
+	};
+	const auto capture_buffer = [&](ResourceHandle handle)
+	{
+		if (!device.buffers_.IsValid(handle) || !captured_buffers.insert(handle).second) { return; }
+		const Buffer* buffer = device.buffers_.AccessResource(handle);
+		CapturedBuffer& captured = buffers_.emplace_back();
+		captured.handle_ = handle;
+		captured.type_ = buffer->type_;
+		captured.usage_ = buffer->usage_;
+		captured.index_format_ = buffer->index_format_;
+		// The null backend keeps no contents, its buffers are captured zeroed.
+		captured.data_.resize(buffer->size_);
+		if (device.GetBackend() == DeviceBackend::kNull || buffer->size_ == 0) { return; }
+		if (buffer->mapped_data_) { std::memcpy(captured.data_.data(), buffer->mapped_data_, buffer->size_); }
+		else
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer->gl_handle_);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, buffer->size_, captured.data_.data());
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+	};
+
+	const auto capture_sampler = [&](ResourceHandle handle)
+	{
+		if (!device.samplers_.IsValid(handle) || !captured_samplers.insert(handle).second) { return; }
+		samplers_.push_back({handle, device.samplers_.AccessResource(handle)->creation_});
+	};
+
+	ForEachRecordHandle(records_, [&](ResourceHandle& handle, RecordHandle kind)
+	{
+		switch (kind)
+		{
+			case RecordHandle::kRenderPass:
+			{
+				if (!device.render_passes_.IsValid(handle) || !captured_passes.insert(handle).second) { break; }
+				render_passes_.push_back({handle, device.render_passes_.AccessResource(handle)->is_swapchain_});
+				break;
+			}
+			case RecordHandle::kPipeline:
+			{
+				if (!device.pipelines_.IsValid(handle) || !captured_pipelines.insert(handle).second) { break; }
+				pipelines_.push_back({handle, device.pipelines_.AccessResource(handle)->creation_});
+				break;
+			}
+			case RecordHandle::kResourceList:
+			{
+				if (!device.resource_lists_.IsValid(handle) || !captured_lists.insert(handle).second) { break; }
+				const ResourceList* resource_list = device.resource_lists_.AccessResource(handle);
+				CapturedResourceList& captured = resource_lists_.emplace_back();
+				captured.handle_ = handle;
+				for (uint32_t i = 0; i < resource_list->num_bindings_; ++i)
+				{
+					const ResourceListBinding& binding = resource_list->bindings_[i];
+					captured.items_.push_back({binding.type_, binding.handle_, binding.binding_, binding.range_});
+					if (IsTextureBinding(binding.type_)) { capture_texture(binding.handle_); }
+					else if (IsBufferBinding(binding.type_)) { capture_buffer(binding.handle_); }
+					else if (binding.type_ == ResourceType::kSampler) { capture_sampler(binding.handle_); }
+				}
+				break;
+			}
+			case RecordHandle::kBuffer: capture_buffer(handle); break;
+		}
+	});
+}
+
+void FrameCapture::Save(const std::string& file_path)
+{
+	BinarySerializer serializer(SerializerAction::kWrite, file_path);
+	uint32_t magic = kMagic;
+	uint32_t version = kVersion;
+	serializer << magic << version << *this;
+	serializer.Wait();
+}
+
+void FrameCapture::Load(const std::string& file_path)
+{
+	BinarySerializer serializer(SerializerAction::kRead, file_path);
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	serializer << magic << version;
+	if (magic != kMagic) { throw std::runtime_error("Not a frame capture: " + file_path); }
+	if (version != kVersion) { throw std::runtime_error("Unsupported frame capture version " + std::to_string(version) + ": " + file_path); }
+	*this = FrameCapture();
+	serializer << *this;
+	for (size_t offset = 0; offset < records_.size();)
+	{
+		const bool has_header = records_.size() - offset >= sizeof(CommandHeader);
+		const uint16_t size = has_header
+		                      ? reinterpret_cast<const CommandHeader*>(records_.data() + offset)->size_
+		                      : 0;
+		if (size < sizeof(CommandHeader) || offset + size > records_.size()) { throw std::runtime_error("Corrupted frame capture: " + file_path); }
+		offset += size;
+	}
+}
+
+void FrameCapture::CreateResources(Device& device)
+{
+	DestroyResources(device);
+	for (const CapturedTexture& texture : textures_)
+	{
+		texture_map_[texture.handle_] = device.CreateTexture(TextureCreation(texture.width_, texture.height_, texture.format_, "CapturedTexture"));
+	}
+	for (const CapturedBuffer& buffer : buffers_)
+	{
+		const void* data = buffer.data_.empty()
+		                   ? nullptr
+		                   : buffer.data_.data();
+		BufferCreation creation(buffer.type_, buffer.usage_, static_cast<uint32_t>(buffer.data_.size()), "CapturedBuffer", data);
+		creation.index_format_ = buffer.index_format_;
+		buffer_map_[buffer.handle_] = device.CreateBuffer(creation);
+	}
+	for (const CapturedSampler& sampler : samplers_) { sampler_map_[sampler.handle_] = device.CreateSampler(sampler.creation_); }
+	for (const CapturedResourceList& resource_list : resource_lists_)
+	{
+		ResourceListCreation creation;
+		for (const ResourceListCreation::Item& item : resource_list.items_)
+		{
+			const HandleMap* map = &buffer_map_;
+			if (IsTextureBinding(item.type_)) { map = &texture_map_; }
+			else if (item.type_ == ResourceType::kSampler) { map = &sampler_map_; }
+			const ResourceHandle handle = Remap(*map, item.handle_);
+			// Resources destroyed before the capture was taken.
+			if (handle == kInvalidHandle) { continue; }
+			creation.Add(item.type_, handle, item.binding_, item.range_);
+		}
+		resource_list_map_[resource_list.handle_] = device.CreateResourceList(creation);
+	}
+	for (const CapturedPipeline& pipeline : pipelines_) { pipeline_map_[pipeline.handle_] = device.CreatePipeline(pipeline.creation_); }
+	for (const CapturedRenderPass& render_pass : render_passes_)
+	{
+		const ResourceHandle handle = device.render_passes_.AllocateResource();
+		if (handle == kInvalidHandle) { continue; }
+		RenderPass* replay_pass = device.render_passes_.AccessResource(handle);
+		replay_pass->fbo_handle_ = 0;
+		replay_pass->is_swapchain_ = render_pass.is_swapchain_;
+		render_pass_map_[render_pass.handle_] = handle;
+	}
+
+	replay_records_ = records_;
+	ForEachRecordHandle(replay_records_, [&](ResourceHandle& handle, RecordHandle kind)
+	{
+		switch (kind)
+		{
+			case RecordHandle::kRenderPass: handle = Remap(render_pass_map_, handle); break;
+			case RecordHandle::kPipeline: handle = Remap(pipeline_map_, handle); break;
+			case RecordHandle::kResourceList: handle = Remap(resource_list_map_, handle); break;
+			case RecordHandle::kBuffer: handle = Remap(buffer_map_, handle); break;
+		}
+	});
+}
+
+void FrameCapture::DestroyResources(Device& device)
+{
+	for (const auto& entry : pipeline_map_) { device.DestroyPipeline(entry.second); }
+	for (const auto& entry : resource_list_map_) { device.DestroyResourceList(entry.second); }
+	for (const auto& entry : buffer_map_) { device.DestroyBuffer(entry.second); }
+	for (const auto& entry : sampler_map_) { device.DestroySampler(entry.second); }
+	for (const auto& entry : texture_map_) { device.DestroyTexture(entry.second); }
+	for (const auto& entry : render_pass_map_) { device.render_passes_.ReleaseResource(entry.second); }
+	pipeline_map_.clear();
+	resource_list_map_.clear();
+	buffer_map_.clear();
+	sampler_map_.clear();
+	texture_map_.clear();
+	render_pass_map_.clear();
+	replay_records_.clear();
+}
+
+void FrameCapture::Replay(Device& device) const { device.ExecuteCommandRecords(replay_records_.data(), static_cast<uint32_t>(replay_records_.size())); }
+
+uint32_t FrameCapture::GetCommandCount() const
+{
+	uint32_t count = 0;
+	for (size_t offset = 0; offset < records_.size(); ++count)
+	{
+		offset += reinterpret_cast<const CommandHeader*>(records_.data() + offset)->size_;
+	}
+	return count;
+}
+}
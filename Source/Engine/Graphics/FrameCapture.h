@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Graphics.h"
+
+namespace graphics
+{
+// One executed frame with everything it references, so it can be replayed on another device without the application
+// or its assets: the command records in execution order, the pipelines, resource lists, samplers, textures and render
+// passes they use, and the contents of every referenced buffer at the end of the frame.
+//
+// Textures are recreated empty and render passes target the default framebuffer, so a replay reproduces the work of a
+// frame rather than its image. Capture files are meant to be kept as regression benchmarks, see CaptureReplay.
+class FrameCapture
+{
+public:
+	// "DCAP".
+	static constexpr uint32_t kMagic = 0x50414344;
+	static constexpr uint32_t kVersion = 3;
+
+	struct CapturedRenderPass
+	{
+		ResourceHandle handle_ = kInvalidHandle;
+		uint32_t is_swapchain_ = 0;
+	};
+
+	struct CapturedTexture
+	{
+		ResourceHandle handle_ = kInvalidHandle;
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		TextureFormat format_ = TextureFormat::UNKNOWN;
+	};
+
+	struct CapturedBuffer
+	{
+		ResourceHandle handle_ = kInvalidHandle;
+		BufferType type_ = BufferType::Vertex;
+		ResourceUsageType usage_ = ResourceUsageType::Immutable;
+		IndexFormat index_format_ = IndexFormat::Uint16;
+		std::vector<uint8_t> data_;
+
+		SERIALIZE_FIELDS(&CapturedBuffer::handle_, &CapturedBuffer::type_, &CapturedBuffer::usage_, &CapturedBuffer::index_format_,
+			&CapturedBuffer::data_)
+	};
+
+	struct CapturedSampler
+	{
+		ResourceHandle handle_ = kInvalidHandle;
+		SamplerCreation creation_;
+
+		SERIALIZE_FIELDS(&CapturedSampler::handle_, &CapturedSampler::creation_)
+	};
+
+	struct CapturedResourceList
+	{
+		ResourceHandle handle_ = kInvalidHandle;
+		std::vector<ResourceListCreation::Item> items_;
+
+		SERIALIZE_FIELDS(&CapturedResourceList::handle_, &CapturedResourceList::items_)
+	};
+
+	struct CapturedPipeline
+	{
+		ResourceHandle handle_ = kInvalidHandle;
+		PipelineCreation creation_;
+
+		SERIALIZE_FIELDS(&CapturedPipeline::handle_, &CapturedPipeline::creation_)
+	};
+
+	// records are the packed records executed by the frame. Reads buffer contents back, GL thread only.
+	void Capture(Device& device, const std::vector<uint8_t>& records);
+	void Save(const std::string& file_path);
+	// Throws std::runtime_error when the file is not a capture of this version.
+	void Load(const std::string& file_path);
+
+	// Creates the captured resources on device and points the records at them. Throws std::runtime_error when a
+	// pipeline fails to compile on device.
+	void CreateResources(Device& device);
+	void DestroyResources(Device& device);
+	// Executes the frame on the device given to CreateResources, as one ExecuteCommandBuffers.
+	void Replay(Device& device) const;
+
+	uint32_t GetCommandCount() const;
+
+	std::vector<uint8_t> records_;
+	std::vector<CapturedRenderPass> render_passes_;
+	std::vector<CapturedTexture> textures_;
+	std::vector<CapturedBuffer> buffers_;
+	std::vector<CapturedSampler> samplers_;
+	std::vector<CapturedResourceList> resource_lists_;
+	std::vector<CapturedPipeline> pipelines_;
+
+	SERIALIZE_FIELDS(&FrameCapture::records_, &FrameCapture::render_passes_, &FrameCapture::textures_, &FrameCapture::buffers_,
+		&FrameCapture::samplers_, &FrameCapture::resource_lists_, &FrameCapture::pipelines_)
+
+protected:
+	// Captured handle to device handle, per resource pool.
+	using HandleMap = std::unordered_map<ResourceHandle, ResourceHandle>;
+
+	HandleMap render_pass_map_;
+	HandleMap texture_map_;
+	HandleMap buffer_map_;
+	HandleMap sampler_map_;
+	HandleMap resource_list_map_;
+	HandleMap pipeline_map_;
+	// records_ with the handles of the replay device.
+	std::vector<uint8_t> replay_records_;
+};
+}
@@ -1,15 +1,37 @@
 ﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include "vec4.hpp"
+#include "Serlalizer/Reflection.h"
 #include "../../ThirdParty/glfw/deps/glad/gl.h"
 #include "code/Common/Win32DebugLogStream.h"
 
+class BinarySerializer;
+
 namespace graphics
 {
+using ResourceHandle = uint32_t;
+static constexpr ResourceHandle kInvalidHandle = 0xFFFFFFFF;
+
+static constexpr uint32_t kMaxResourceLists = 8;
+static constexpr uint32_t kMaxResourceListOffsets = 8;
+static constexpr uint32_t kMaxVertexStreams = 16;
+
 enum class ShaderType
 {
 	kVertex = 0, kFragment, kGeometry, kCompute, kHull, kDomain, kCount
@@ -158,34 +180,170 @@ enum class PrimitiveType
 	Unknown, Point, Line, Triangle, Patch, Count
 };
 
-enum class CommandType
+enum class IndexFormat
+{
+	Uint16, Uint32, Count
+};
+
+enum class DeviceBackend
+{
+	// Executes through GL.
+	kOpenGL,
+	// Makes no GL calls: resources get fake GL names and execution validates handles and counts work instead.
+	// Runs without a context, for tests and benchmarks on machines without a GPU.
+	kNull
+};
+
+enum class CommandType : uint16_t
 {
 	BindPipeline, BindResourceListLayout, BindVertexBuffer, BindIndexBuffer, BindResourceList, Draw, DrawIndexed, DrawInstanced, DrawIndexedInstanced,
-	Dispatch, CopyResource, SetScissor, SetViewport, Clear, ClearDepth, ClearStencil, BeginPass, EndPass, Count
+	Dispatch, CopyResource, SetScissor, SetViewport, Clear, ClearDepth, ClearStencil, BeginPass, EndPass, DrawIndirect, DrawIndexedIndirect,
+	Count
 };
 
+enum class ComparisonFunction : uint8_t
+{
+	kNever = 0, kLess, kEqual, kLessEqual, kGreater, kNotEqual, kGreaterEqual, kAlways, kCount
+};
+
+enum class StencilOperation : uint8_t
+{
+	kKeep = 0, kZero, kReplace, kIncrementClamp, kDecrementClamp, kInvert, kIncrementWrap, kDecrementWrap, kCount
+};
+
+enum class Blend : uint8_t
+{
+	kZero = 0, kOne, kSrcColor, kInvSrcColor, kSrcAlpha, kInvSrcAlpha, kDestAlpha, kInvDestAlpha, kDestColor, kInvDestColor, kSrcAlphaSat,
+	kSrc1Color, kInvSrc1Color, kSrc1Alpha, kInvSrc1Alpha, kCount
+};
+
+enum class BlendOperation : uint8_t
+{
+	kAdd = 0, kSubtract, kRevSubtract, kMin, kMax, kCount
+};
+
+namespace VertexComponentFormat
+{
+enum Enum
+{
+	Float, Float2, Float3, Float4, Mat4, Byte, Byte4N, UByte, UByte4N, Short2, Short2N, Short4, Short4N, Count
+};
+}
+
+namespace TextureFilter
+{
+enum Enum
+{
+	Nearest, Linear, Count
+};
+}
+
+// None samples the base level only, for textures without mipmaps.
+namespace TextureMipFilter
+{
+enum Enum
+{
+	Nearest, Linear, None, Count
+};
+}
+
+namespace TextureAddressMode
+{
+enum Enum
+{
+	Repeat, MirroredRepeat, ClampEdge, ClampBorder, Count
+};
+}
+
 struct RasterizationState
 {
-	CullMode cull_mode_;
-	FontCounterClockwise front_counter_clockwise_;
-	FillMode fill_mode_;
+	CullMode cull_mode_ = CullMode::kNone;
+	FontCounterClockwise front_counter_clockwise_ = FontCounterClockwise::kTrue;
+	FillMode fill_mode_ = FillMode::kSolid;
 };
 
 struct DepthStencilState
 {
-	//TODO
-	bool depth_test_;
-	bool depth_write_;
+	bool depth_test_ = false;
+	bool depth_write_ = false;
+	ComparisonFunction depth_comparison_ = ComparisonFunction::kLessEqual;
+	// Applied to both faces.
+	bool stencil_test_ = false;
+	ComparisonFunction stencil_comparison_ = ComparisonFunction::kAlways;
+	StencilOperation stencil_fail_ = StencilOperation::kKeep;
+	StencilOperation stencil_depth_fail_ = StencilOperation::kKeep;
+	StencilOperation stencil_pass_ = StencilOperation::kKeep;
+	uint8_t stencil_reference_ = 0;
+	uint8_t stencil_read_mask_ = 0xFF;
+	uint8_t stencil_write_mask_ = 0xFF;
 };
 
 struct BlendState
 {
-	//TODO
-	bool blend_enable_;
+	bool blend_enable_ = false;
+	Blend source_color_ = Blend::kOne;
+	Blend destination_color_ = Blend::kZero;
+	BlendOperation color_operation_ = BlendOperation::kAdd;
 };
 
+struct ShaderCreation
+{
+	ShaderType type_ = ShaderType::kVertex;
+	std::string code_;
+
+	SERIALIZE_FIELDS(&ShaderCreation::type_, &ShaderCreation::code_)
+};
+
+struct VertexStream
+{
+	uint32_t binding_ = 0;
+	uint32_t stride_ = 0;
+};
+
+struct VertexAttribute
+{
+	uint16_t location_ = 0;
+	uint16_t binding_ = 0;
+	uint32_t offset_ = 0;
+	VertexComponentFormat::Enum format_ = VertexComponentFormat::Float;
+};
+
+// Shader stages, vertex input and fixed function state of a pipeline. Everything but the name is hashed, and equal
+// creations get the same pipeline from Device::CreatePipeline. A pipeline with a compute shader is a compute pipeline.
 class PipelineCreation
-{};
+{
+public:
+	PipelineCreation& AddShader(ShaderType type, std::string code)
+	{
+		shaders_.push_back({type, std::move(code)});
+		return *this;
+	}
+
+	PipelineCreation& AddVertexStream(uint32_t binding, uint32_t stride)
+	{
+		vertex_streams_.push_back({binding, stride});
+		return *this;
+	}
+
+	PipelineCreation& AddVertexAttribute(uint16_t location, uint16_t binding, uint32_t offset, VertexComponentFormat::Enum format)
+	{
+		vertex_attributes_.push_back({location, binding, offset, format});
+		return *this;
+	}
+
+	uint64_t GetHash() const { return reflection::HashValue(*this); }
+
+	std::vector<ShaderCreation> shaders_;
+	std::vector<VertexStream> vertex_streams_;
+	std::vector<VertexAttribute> vertex_attributes_;
+	RasterizationState rasterization_;
+	DepthStencilState depth_stencil_;
+	BlendState blend_;
+	std::string name_;
+
+	SERIALIZE_FIELDS(&PipelineCreation::shaders_, &PipelineCreation::vertex_streams_, &PipelineCreation::vertex_attributes_,
+		&PipelineCreation::rasterization_, &PipelineCreation::depth_stencil_, &PipelineCreation::blend_)
+};
 
 class ResourceListLayoutCreation
 {};
@@ -194,19 +352,41 @@ class ResourceListLayout
 {};
 
 class ResourceListCreation
-{};
+{
+public:
+	struct Item
+	{
+		ResourceType type_;
+		ResourceHandle handle_;
+		uint32_t binding_;
+		uint32_t range_;
+	};
+
+	// range is the size of the constant block bound at a dynamic offset, 0 binds the rest of the buffer.
+	ResourceListCreation& Add(ResourceType type, ResourceHandle handle, uint32_t binding, uint32_t range = 0)
+	{
+		items_.push_back({type, handle, binding, range});
+		return *this;
+	}
+
+	std::vector<Item> items_;
+};
 
 class BufferCreation
 {
 public:
-	BufferCreation(BufferType type, ResourceUsageType usage, uint32_t size, std::string name) :
-		type_(type), usage_(usage), size_(size), name_(std::move(name)) {}
+	BufferCreation(BufferType type, ResourceUsageType usage, uint32_t size, std::string name, const void* initial_data = nullptr) :
+		type_(type), usage_(usage), size_(size), name_(std::move(name)), initial_data_(initial_data) {}
 
-protected:
 	BufferType type_;
 	ResourceUsageType usage_;
 	uint32_t size_;
 	std::string name_;
+	const void* initial_data_;
+	// Persistently and coherently mapped for writing when the GL supports buffer storage, see Buffer::mapped_data_.
+	bool persistent_ = false;
+	// Element type read by indexed draws when bound as the index buffer.
+	IndexFormat index_format_ = IndexFormat::Uint16;
 };
 
 class TextureCreation
@@ -221,20 +401,80 @@ public:
 	std::string name_;
 };
 
+struct SamplerCreation
+{
+	TextureFilter::Enum min_filter_ = TextureFilter::Linear;
+	TextureFilter::Enum mag_filter_ = TextureFilter::Linear;
+	TextureMipFilter::Enum mip_filter_ = TextureMipFilter::None;
+	TextureAddressMode::Enum address_mode_u_ = TextureAddressMode::Repeat;
+	TextureAddressMode::Enum address_mode_v_ = TextureAddressMode::Repeat;
+	std::string name_;
+
+	SERIALIZE_FIELDS(&SamplerCreation::min_filter_, &SamplerCreation::mag_filter_, &SamplerCreation::mip_filter_,
+		&SamplerCreation::address_mode_u_, &SamplerCreation::address_mode_v_, &SamplerCreation::name_)
+};
+
 class Texture
-{};
+{
+public:
+	GLuint gl_handle_ = 0;
+	uint32_t width_ = 0;
+	uint32_t height_ = 0;
+	TextureFormat format_ = TextureFormat::UNKNOWN;
+};
 
 class Buffer
 {
 public:
-	GLuint gl_handle_;
+	GLuint gl_handle_ = 0;
+	GLenum gl_type_ = 0;
+	BufferType type_ = BufferType::Vertex;
+	ResourceUsageType usage_ = ResourceUsageType::Immutable;
+	IndexFormat index_format_ = IndexFormat::Uint16;
+	uint32_t size_ = 0;
+	void* mapped_data_ = nullptr;
 };
 
 class Pipeline
-{};
+{
+public:
+	GLuint gl_program_ = 0;
+	GLuint gl_vao_ = 0;
+	// Cache keys of the pipeline, its program and its vertex array, and the number of CreatePipeline calls it serves.
+	uint64_t hash_ = 0;
+	uint64_t program_hash_ = 0;
+	uint64_t vertex_array_hash_ = 0;
+	uint32_t references_ = 0;
+	bool graphics_pipeline_ = true;
+	RasterizationState rasterization_;
+	DepthStencilState depth_stencil_;
+	BlendState blend_;
+	VertexStream vertex_streams_[kMaxVertexStreams];
+	uint32_t num_vertex_streams_ = 0;
+	// Kept for frame captures.
+	PipelineCreation creation_;
+};
+
+// GL objects of a resource list, resolved from their handles when the list is created.
+struct ResourceListBinding
+{
+	ResourceType type_ = ResourceType::kTexture;
+	ResourceHandle handle_ = kInvalidHandle;
+	GLuint gl_handle_ = 0;
+	GLenum gl_format_ = 0;
+	uint32_t binding_ = 0;
+	uint32_t size_ = 0;
+	uint32_t range_ = 0;
+};
 
 class ResourceList
-{};
+{
+public:
+	static constexpr uint32_t kMaxBindings = 16;
+
+	ResourceListBinding bindings_[kMaxBindings];
+	uint32_t num_bindings_ = 0;
+};
 
 class Shader
 {};
@@ -254,26 +494,212 @@ struct Viewport
 	float max_depth = 0.0f;
 };
 
+class Device;
+
 class VertexBufferFactory
 {
 public:
-	static std::shared_ptr<Buffer> CreateFullScreenQuad() { return std::make_shared<Buffer>(); }
+	// Single triangle covering the screen, drawn with 3 vertices.
+	static ResourceHandle CreateFullScreenQuad(Device& device);
+};
+
+struct SortEntry
+{
+	uint64_t key_;
+	uint32_t index_;
 };
 
+// Stable LSD radix sort on SortEntry::key_, one byte per pass. Passes over a byte shared by every key are skipped.
+// scratch must hold count entries.
+void RadixSort(SortEntry* entries, SortEntry* scratch, uint32_t count);
+
+// Linear arena of tightly packed command records. Recording copies a record to the end of the arena and only
+// allocates when the arena runs out of space; Reset rewinds it and keeps the memory, so a command buffer that is
+// reused every frame stops allocating once it has reached the size of the largest frame.
+//
+// Draws recorded between BeginSubmit and EndSubmit are reordered by sort key at EndSubmit. Each draw keeps the
+// offsets of the state records in effect when it was recorded and replays them ahead of itself, so reordering
+// never changes what a draw binds. Passes, clears and dispatches are barriers: draws are never moved across them.
 class CommandBuffer
 {
 public:
-	void BeginSubmit() {}
-	void EndSubmit() {}
-	void BindPipeline(std::shared_ptr<Pipeline> pipeline) {}
-	void BindResourceList(std::shared_ptr<ResourceList> resource_list) {}
-	void BindVertexBuffer(std::shared_ptr<Buffer> buffer, uint32_t binding, uint32_t offset) {}
-	void Draw(PrimitiveType type, uint32_t start, uint32_t count, uint32_t instance_count = 0) {}
-	void Dispatch(uint32_t group_x, uint32_t group_y, uint32_t group_z) {}
+	static constexpr uint32_t kDefaultCapacity = 8 * 1024 * 1024;
+	static constexpr uint32_t kRecordAlignment = 4;
+
+	// State changes between consecutive draws (pipeline and resource list), in recording and in sorted order.
+	struct SortStats
+	{
+		uint32_t draw_count_ = 0;
+		uint32_t state_changes_recorded_ = 0;
+		uint32_t state_changes_sorted_ = 0;
+	};
+
+	explicit CommandBuffer(uint32_t capacity = 0)
+	{
+		buffer_.resize(capacity);
+		Reset();
+	}
+
+	void Reset();
+
+	// pass ranks the draws of this submit against other submits when command buffers are merged. Commands recorded
+	// outside a submit use the pass of the last one.
+	void BeginSubmit(uint8_t pass = 0);
+	void EndSubmit();
+	// Depth used by the sort key of the following draws. Opaque draws sort front to back within their state,
+	// translucent draws sort back to front ahead of state.
+	void SetSortDepth(float depth, bool translucent = false);
+
+	void BeginPass(ResourceHandle render_pass);
+	void EndPass();
+	void BindPipeline(ResourceHandle pipeline);
+	void BindResourceList(const ResourceHandle* resource_lists, uint32_t num_lists, const uint32_t* offsets = nullptr, uint32_t num_offsets = 0);
+	void BindResourceList(ResourceHandle resource_list) { BindResourceList(&resource_list, 1); }
+	// offset is the dynamic offset of the first constant buffer of the list, e.g. a RingBuffer allocation.
+	void BindResourceList(ResourceHandle resource_list, uint32_t offset) { BindResourceList(&resource_list, 1, &offset, 1); }
+	void BindVertexBuffer(ResourceHandle buffer, uint32_t binding, uint32_t offset);
+	void BindIndexBuffer(ResourceHandle buffer);
+	void SetViewport(const Viewport& viewport);
+	void SetScissor(const Rect2D& rect);
+	void Clear(const glm::vec4& color);
+	void ClearDepth(float value);
+	void ClearStencil(uint8_t value);
+	void Draw(PrimitiveType type, uint32_t start, uint32_t count, uint32_t instance_count = 0);
+	void DrawIndexed(PrimitiveType type, uint32_t index_count, uint32_t instance_count = 0, uint32_t first_index = 0, int32_t vertex_offset = 0,
+		uint32_t first_instance = 0);
+	// draw_count draws read from indirect_buffer at offset, stride apart; stride 0 means tightly packed. The arguments
+	// are DrawArraysIndirectArguments and DrawElementsIndirectArguments.
+	void DrawIndirect(PrimitiveType type, ResourceHandle indirect_buffer, uint32_t offset, uint32_t draw_count, uint32_t stride = 0);
+	void DrawIndexedIndirect(PrimitiveType type, ResourceHandle indirect_buffer, uint32_t offset, uint32_t draw_count, uint32_t stride = 0);
+	void Dispatch(uint32_t group_x, uint32_t group_y, uint32_t group_z);
+
+	// Replays the recorded commands, submits in sorted order.
+	void Execute(Device& device) const;
+
+	// The replay order is a list of units, a draw or dispatch with the state records it needs or a single barrier.
+	// Units are tagged with their sort key and grouped in runs: the units of one submit, or consecutive units recorded
+	// outside a submit. The device merges the runs of all queued buffers by key, keeping the order within each run.
+	// Keys never decrease within a run: a unit recorded after one with a larger key, such as a dispatch following the
+	// draws of its submit, takes that larger key, so it stays behind them in the merge.
+	uint32_t GetReplayUnitCount() const { return static_cast<uint32_t>(replay_units_.size()); }
+	uint64_t GetReplayUnitKey(uint32_t unit) const { return replay_units_[unit].key_; }
+	void ExecuteReplayUnit(uint32_t unit, Device& device) const;
+	uint32_t GetReplayRunCount() const { return static_cast<uint32_t>(replay_runs_.size()); }
+
+	void GetReplayRun(uint32_t run, uint32_t& first_unit, uint32_t& end_unit) const
+	{
+		first_unit = replay_runs_[run];
+		end_unit = run + 1 < replay_runs_.size()
+		           ? replay_runs_[run + 1]
+		           : static_cast<uint32_t>(replay_units_.size());
+	}
+
+	// Most significant bits first:
+	//   opaque:      pass (8) | 0 | 0 | pipeline (16) | resource list (16) | depth (22)
+	//   translucent: pass (8) | 0 | 1 | inverted depth (22) | pipeline (16) | resource list (16)
+	// plus one, so no draw shares a key with the barriers of its pass. Pipeline and resource list contribute the low
+	// 16 bits of their pool index. depth is clamped to positive values and quantized to the top 22 bits of its float
+	// representation, which preserves ordering.
+	static uint64_t MakeDrawSortKey(uint8_t pass, ResourceHandle pipeline, ResourceHandle resource_list, float depth, bool translucent);
+	// Passes, clears and dispatches sort strictly ahead of the draws of their pass; the end of a pass sorts after them.
+	static uint64_t MakeBarrierSortKey(uint8_t pass, bool ends_pass);
+
+	uint32_t GetSize() const { return size_; }
+	uint32_t GetCapacity() const { return static_cast<uint32_t>(buffer_.size()); }
+	uint32_t GetCommandCount() const { return command_count_; }
+	const SortStats& GetSortStats() const { return sort_stats_; }
+
+protected:
+	static constexpr uint32_t kNoRecord = 0xFFFFFFFF;
+
+	struct ReplayUnit
+	{
+		uint64_t key_;
+		uint32_t first_offset_;
+		uint32_t offset_count_;
+	};
+
+	struct SubmitEntry
+	{
+		uint64_t key_;
+		uint32_t first_offset_;
+		uint32_t offset_count_;
+		ResourceHandle pipeline_;
+		ResourceHandle resource_list_;
+		bool barrier_;
+	};
+
+	template <typename T>
+	T& AllocateCommand()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Command records must be plain data");
+		static_assert(alignof(T) <= kRecordAlignment, "Command records are packed on kRecordAlignment");
+		constexpr uint32_t kSize = (sizeof(T) + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+		static_assert(kSize <= UINT16_MAX, "Command record too large for its header");
+
+		if (size_ + kSize > buffer_.size())
+		{
+			const size_t grown = buffer_.size() * 2;
+			buffer_.resize(grown > kDefaultCapacity ? grown : kDefaultCapacity);
+		}
+		T* command = reinterpret_cast<T*>(buffer_.data() + size_);
+		last_record_ = size_;
+		size_ += kSize;
+		++command_count_;
+		command->header_.type_ = T::kType;
+		command->header_.size_ = static_cast<uint16_t>(kSize);
+		return *command;
+	}
+
+	// Adds the last allocated record to the replay order, preceded by the bound state records when with_state is set.
+	void SubmitRecord(bool is_draw, bool with_state, bool ends_pass = false);
+	// Raises key to the last key of the open run.
+	uint64_t ClampToRun(uint64_t key) const;
+	void AppendReplayUnit(const SubmitEntry& entry);
+	void AppendStateRecords(std::vector<uint32_t>& offsets) const;
+	void SortSubmitRange(uint32_t begin, uint32_t end);
+	void CountStateChange(const SubmitEntry& entry, ResourceHandle& pipeline, ResourceHandle& resource_list, uint32_t& changes) const;
+
+	std::vector<uint8_t> buffer_;
+	uint32_t size_ = 0;
+	uint32_t command_count_ = 0;
+	uint32_t last_record_ = kNoRecord;
+
+	// Offsets of the state records in effect, kNoRecord when unset.
+	uint32_t pipeline_record_ = kNoRecord;
+	uint32_t resource_list_record_ = kNoRecord;
+	uint32_t index_buffer_record_ = kNoRecord;
+	uint32_t viewport_record_ = kNoRecord;
+	uint32_t scissor_record_ = kNoRecord;
+	uint32_t vertex_buffer_records_[kMaxVertexStreams];
+	ResourceHandle pipeline_handle_ = kInvalidHandle;
+	ResourceHandle resource_list_handle_ = kInvalidHandle;
+
+	bool in_submit_ = false;
+	uint8_t submit_pass_ = 0;
+	float sort_depth_ = 0.0f;
+	bool sort_translucent_ = false;
+	std::vector<SubmitEntry> submit_entries_;
+	std::vector<uint32_t> submit_offsets_;
+	std::vector<SortEntry> sort_entries_;
+	std::vector<SortEntry> sort_scratch_;
+
+	// Record offsets in execution order, grouped in units.
+	std::vector<uint32_t> replay_offsets_;
+	std::vector<ReplayUnit> replay_units_;
+	// First unit of each run.
+	std::vector<uint32_t> replay_runs_;
+	bool unsubmitted_run_open_ = false;
+	SortStats sort_stats_;
 };
 
 class Sampler
-{};
+{
+public:
+	GLuint gl_handle_ = 0;
+	// Kept for frame captures.
+	SamplerCreation creation_;
+};
 
 class RenderPass
 {
@@ -282,199 +708,576 @@ public:
 	uint32_t is_swapchain_;
 };
 
+// Fixed size slab of T addressed by generational handles. A handle packs the slot index in its low kIndexBits and
+// the slot generation above it; releasing a slot bumps the generation, so stale handles fail IsValid.
+// AccessResource is a masked index into the slab and does no validation outside of debug builds.
+// Pointers returned by AccessResource are invalidated when the pool grows, hold on to handles instead.
+template <typename T>
 class ResourcePool
 {
 public:
-	using HandleType = uint32_t;
-	static const HandleType kInvalidHandle = 0xFFFFFFFF;
-	ResourcePool() {}
+	using HandleType = ResourceHandle;
+	static constexpr HandleType kInvalidHandle = graphics::kInvalidHandle;
+	static constexpr uint32_t kIndexBits = 20;
+	static constexpr uint32_t kIndexMask = (1u << kIndexBits) - 1;
+	static constexpr uint32_t kGenerationMask = (1u << (32 - kIndexBits)) - 1;
+	// The last index is never handed out, which keeps kInvalidHandle from ever being a live handle.
+	static constexpr uint32_t kMaxCount = kIndexMask;
+
+	explicit ResourcePool(uint32_t max_count = 256, bool allow_growth = true) : allow_growth_(allow_growth) { Grow(max_count); }
 
 	HandleType AllocateResource()
 	{
-		if (current_head_count_ < max_count_)
+		if (free_indices_.empty())
 		{
-			//TODO
-			return current_head_count_++;
+			const uint32_t max_count = static_cast<uint32_t>(resources_.size());
+			if (!allow_growth_ || max_count == kMaxCount) { return kInvalidHandle; }
+			// An empty pool (max_count 0) still has to make room for this allocation.
+			Grow(std::max(1u, max_count * 2 < kMaxCount ? max_count * 2 : kMaxCount));
 		}
+		const uint32_t index = free_indices_.back();
+		free_indices_.pop_back();
+		++used_count_;
+		return (generations_[index] << kIndexBits) | index;
 	}
 
 	void ReleaseResource(HandleType handle)
 	{
-		// TODO
+		if (!IsValid(handle)) { return; }
+		const uint32_t index = handle & kIndexMask;
+		resources_[index] = T();
+		generations_[index] = (generations_[index] + 1) & kGenerationMask;
+		free_indices_.push_back(index);
+		--used_count_;
 	}
 
-	void* AccessResource(HandleType handle) { return const_cast<void*>(static_cast<const ResourcePool*>(this)->AccessResource(handle)); }
+	bool IsValid(HandleType handle) const
+	{
+		const uint32_t index = handle & kIndexMask;
+		return handle != kInvalidHandle && index < generations_.size() && generations_[index] == handle >> kIndexBits;
+	}
 
-	const void* AccessResource(HandleType handle) const
+	T* AccessResource(HandleType handle)
 	{
-		if (handle != kInvalidHandle) { return &memory_[handle * resource_size_]; }
-		return nullptr;
+		assert(IsValid(handle));
+		return &resources_[handle & kIndexMask];
 	}
 
+	const T* AccessResource(HandleType handle) const
+	{
+		assert(IsValid(handle));
+		return &resources_[handle & kIndexMask];
+	}
+
+	uint32_t GetUsedCount() const { return used_count_; }
+	uint32_t GetMaxCount() const { return static_cast<uint32_t>(resources_.size()); }
+
 protected:
-	uint8_t* memory_;
-	uint32_t max_count_;
-	uint32_t resource_size_;
-	uint32_t current_head_count_;
-};
+	void Grow(uint32_t max_count)
+	{
+		const uint32_t old_count = static_cast<uint32_t>(resources_.size());
+		resources_.resize(max_count);
+		generations_.resize(max_count, 0);
+		// Pushed in reverse so low indices are handed out first.
+		for (uint32_t i = max_count; i > old_count; --i) { free_indices_.push_back(i - 1); }
+	}
 
-class Device;
+	std::vector<T> resources_;
+	std::vector<uint32_t> generations_;
+	std::vector<uint32_t> free_indices_;
+	uint32_t used_count_ = 0;
+	bool allow_growth_;
+};
 
-class Command
+// Every command record in a CommandBuffer starts with this header. size_ is the size of the whole record, so the stream
+// can be walked without knowing every command type.
+struct CommandHeader
 {
-public:
-	virtual void Execute(Device& Device) = 0;
-
-protected:
 	CommandType type_;
+	uint16_t size_;
 };
 
-class BeginPassCommand : public Command
+// Command records are plain data copied into the command buffer arena and replayed by CommandBuffer::Execute, which
+// switches on the header type. Records must stay trivially copyable and hold handles, never pointers into the device.
+struct BeginPassCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::BeginPass;
+	void Execute(Device& device) const;
 
-protected:
-	uint32_t handle_;
+	CommandHeader header_;
+	ResourceHandle handle_;
 };
 
-class EndPassCommand : public Command
+struct EndPassCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::EndPass;
+	void Execute(Device& device) const;
+
+	CommandHeader header_;
 };
 
-class BindVertexBufferCommand : public Command
+struct BindVertexBufferCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::BindVertexBuffer;
+	void Execute(Device& device) const;
 
-protected:
-	uint32_t buffer_handle_;
+	CommandHeader header_;
+	ResourceHandle buffer_handle_;
 	uint32_t binding_;
 	uint32_t byte_offset_;
 };
 
-class BindIndexBufferCommand : public Command
+struct BindIndexBufferCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::BindIndexBuffer;
+	void Execute(Device& device) const;
 
-protected:
-	uint32_t buffer_handle_;
+	CommandHeader header_;
+	ResourceHandle buffer_handle_;
 };
 
-class SetViewportCommand : public Command
+struct SetViewportCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::SetViewport;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	Viewport viewport_;
 };
 
-class SetScissorCommand : public Command
+struct SetScissorCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::SetScissor;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	Rect2D scissor_;
 };
 
-class ClearColorCommand : public Command
+struct ClearColorCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::Clear;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	glm::vec4 clear_value_;
 };
 
-class ClearDepthCommand : public Command
+struct ClearDepthCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::ClearDepth;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	float clear_value_;
 };
 
-class ClearStencilCommand : public Command
+struct ClearStencilCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::ClearStencil;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	uint8_t clear_value_;
 };
 
-class BindPipelineCommand : public Command
+struct BindPipelineCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::BindPipeline;
+	void Execute(Device& device) const;
 
-protected:
-	uint32_t handle_;
+	CommandHeader header_;
+	ResourceHandle handle_;
 };
 
-class BindResourceListCommand : public Command
+struct BindResourceListCommand
 {
-public:
-	virtual void Execute(Device& device) override;
-
-protected:
-	std::vector<uint32_t> handles_;
-	std::vector<uint32_t> offsets_;
+	static constexpr CommandType kType = CommandType::BindResourceList;
+	void Execute(Device& device) const;
+
+	CommandHeader header_;
+	ResourceHandle handles_[kMaxResourceLists];
+	uint32_t offsets_[kMaxResourceListOffsets];
+	uint32_t num_lists_;
+	uint32_t num_offsets_;
 };
 
-class DispatchCommand : public Command
+struct DispatchCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::Dispatch;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	uint32_t group_count_x_;
 	uint32_t group_count_y_;
 	uint32_t group_count_z_;
 };
 
-class DrawCommand : public Command
+struct DrawCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::Draw;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	PrimitiveType primitive_type_;
 	uint32_t first_vertex_;
 	uint32_t vertex_count_;
 	uint32_t instance_count_;
 };
 
-class DrawIndexedCommand : public Command
+struct DrawIndexedCommand
 {
-public:
-	virtual void Execute(Device& device) override;
+	static constexpr CommandType kType = CommandType::DrawIndexed;
+	void Execute(Device& device) const;
 
-protected:
+	CommandHeader header_;
 	PrimitiveType primitive_type_;
 	uint32_t index_count_;
 	uint32_t instance_count_;
 	uint32_t first_index_;
-	uint32_t vertex_offset_;
+	int32_t vertex_offset_;
+	uint32_t first_instance_;
+};
+
+// Argument layouts of glMultiDrawArraysIndirect and glMultiDrawElementsIndirect.
+struct DrawArraysIndirectArguments
+{
+	uint32_t vertex_count_;
+	uint32_t instance_count_;
+	uint32_t first_vertex_;
 	uint32_t first_instance_;
 };
 
+struct DrawElementsIndirectArguments
+{
+	uint32_t index_count_;
+	uint32_t instance_count_;
+	uint32_t first_index_;
+	int32_t vertex_offset_;
+	uint32_t first_instance_;
+};
+
+struct DrawIndirectCommand
+{
+	static constexpr CommandType kType = CommandType::DrawIndirect;
+	void Execute(Device& device) const;
+
+	CommandHeader header_;
+	PrimitiveType primitive_type_;
+	ResourceHandle buffer_handle_;
+	uint32_t offset_;
+	uint32_t draw_count_;
+	uint32_t stride_;
+};
+
+struct DrawIndexedIndirectCommand
+{
+	static constexpr CommandType kType = CommandType::DrawIndexedIndirect;
+	void Execute(Device& device) const;
+
+	CommandHeader header_;
+	PrimitiveType primitive_type_;
+	ResourceHandle buffer_handle_;
+	uint32_t offset_;
+	uint32_t draw_count_;
+	uint32_t stride_;
+};
+
+// Shadow copy of the GL state bound by the device. Every setter compares against the shadowed value and only calls GL
+// when it differs. Element buffer and vertex buffer bindings belong to the vertex array and are forgotten when it
+// changes. Anything touching GL behind the device's back must call Invalidate.
+class GlStateCache
+{
+public:
+	enum Capability
+	{
+		kDepthTest = 0, kStencilTest, kBlend, kCullFace, kScissorTest, kCapabilityCount
+	};
+
+	struct Stats
+	{
+		uint32_t issued_calls_ = 0;
+		uint32_t redundant_calls_ = 0;
+	};
+
+	static constexpr uint32_t kMaxBindings = 16;
+
+	GlStateCache() { Invalidate(); }
+
+	void Invalidate();
+
+	void SetEnabled(Capability capability, bool enabled);
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vao);
+	void BindFramebuffer(GLuint fbo);
+	void BindElementBuffer(GLuint buffer);
+	void BindIndirectBuffer(GLuint buffer);
+	void BindVertexBuffer(uint32_t binding, GLuint buffer, uint32_t offset, uint32_t stride);
+	void DepthFunc(GLenum func);
+	void DepthMask(bool write);
+	void BlendFunc(GLenum source, GLenum destination);
+	void BlendEquation(GLenum equation);
+	void CullFace(GLenum face);
+	void FrontFace(GLenum face);
+	void PolygonMode(GLenum mode);
+	void Viewport(const Rect2D& rect);
+	void Scissor(const Rect2D& rect);
+	void BindTexture(uint32_t unit, GLuint texture);
+	void BindImageTexture(uint32_t unit, GLuint texture, GLenum format);
+	void BindSampler(uint32_t unit, GLuint sampler);
+	void StencilFunc(GLenum func, uint8_t reference, uint8_t read_mask);
+	void StencilOp(GLenum fail, GLenum depth_fail, GLenum pass);
+	void StencilMask(uint8_t write_mask);
+	// target is GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER. size 0 binds the whole buffer.
+	void BindBufferRange(GLenum target, uint32_t index, GLuint buffer, uint32_t offset, uint32_t size);
+
+	const Stats& GetStats() const { return stats_; }
+	void ResetStats() { stats_ = Stats(); }
+
+protected:
+	static constexpr GLuint kUnknown = 0xFFFFFFFF;
+
+	struct VertexBufferState
+	{
+		GLuint buffer_;
+		uint32_t offset_;
+		uint32_t stride_;
+	};
+
+	struct BufferRangeState
+	{
+		GLuint buffer_;
+		uint32_t offset_;
+		uint32_t size_;
+	};
+
+	// Stores value into cached and returns true when the GL call has to be made.
+	template <typename T>
+	bool Update(T& cached, const T& value)
+	{
+		if (cached == value)
+		{
+			++stats_.redundant_calls_;
+			return false;
+		}
+		cached = value;
+		++stats_.issued_calls_;
+		return true;
+	}
+
+	void InvalidateVertexArrayState();
+
+	GLuint capabilities_[kCapabilityCount];
+	GLuint program_;
+	GLuint vao_;
+	GLuint fbo_;
+	GLuint element_buffer_;
+	GLuint indirect_buffer_;
+	VertexBufferState vertex_buffers_[kMaxVertexStreams];
+	GLuint depth_func_;
+	GLuint depth_mask_;
+	GLuint stencil_func_;
+	GLuint stencil_reference_;
+	GLuint stencil_read_mask_;
+	GLuint stencil_fail_;
+	GLuint stencil_depth_fail_;
+	GLuint stencil_pass_;
+	GLuint stencil_write_mask_;
+	GLuint blend_source_;
+	GLuint blend_destination_;
+	GLuint blend_equation_;
+	GLuint cull_face_;
+	GLuint front_face_;
+	GLuint polygon_mode_;
+	GLuint active_texture_;
+	glm::vec4 viewport_;
+	glm::vec4 scissor_;
+	GLuint textures_[kMaxBindings];
+	GLuint images_[kMaxBindings];
+	GLuint samplers_[kMaxBindings];
+	BufferRangeState uniform_buffers_[kMaxBindings];
+	BufferRangeState storage_buffers_[kMaxBindings];
+	Stats stats_;
+};
+
+// Tracks incoherent shader writes to images and storage buffers, so memory barriers are only issued when a later
+// command accesses what an earlier one wrote. A command declares its reads and writes and then calls Flush, which
+// returns the barrier bits of the hazards found, one bit per kind of access that needs them. Writes stay pending until
+// something consumes them, so consecutive independent dispatches share a single barrier.
+class BarrierTracker
+{
+public:
+	// How a command accesses a resource, each maps to one glMemoryBarrier bit.
+	enum Access
+	{
+		kVertexAttribute = 0, kElementArray, kUniform, kTextureFetch, kImage, kStorage, kCommand, kAccessCount
+	};
+
+	struct Stats
+	{
+		uint32_t barriers_ = 0;
+		uint32_t writes_ = 0;
+	};
+
+	// texture separates texture and buffer names, which GL allocates independently.
+	void Read(GLuint name, bool texture, Access access);
+	// Shader writes through images and storage buffers. A write also waits for earlier writes of the same resource.
+	void Write(GLuint name, bool texture, Access access);
+	// Reads and writes of every binding of the list.
+	void DeclareResourceList(const ResourceList& resource_list);
+	// Ends the command: returns the barrier bits to issue before it, 0 when it has no hazard, and starts tracking its
+	// writes.
+	GLbitfield Flush();
+
+	const Stats& GetStats() const { return stats_; }
+	void ResetStats() { stats_ = Stats(); }
+
+protected:
+	static uint64_t GetKey(GLuint name, bool texture) { return (static_cast<uint64_t>(texture) << 32) | name; }
+
+	// Epoch of the last command writing each resource. A write is visible to an access once a barrier with its bit
+	// was issued at a later epoch.
+	std::unordered_map<uint64_t, uint32_t> write_epochs_;
+	uint32_t barrier_epochs_[kAccessCount] = {};
+	uint32_t epoch_ = 0;
+	uint32_t hazard_mask_ = 0;
+	std::vector<uint64_t> command_writes_;
+	Stats stats_;
+};
+
+// Frame timings of the command layer. CPU scopes time any code on any thread; on the GL backend, every BeginPass/EndPass
+// region replayed by ExecuteCommandBuffers is also bracketed by two timestamp queries. Each ExecuteCommandBuffers call
+// ends a frame, which collects the scopes closed since the previous one.
+//
+// Query results are read back kFrameLatency frames after they were issued, when the GPU is long done with them, so
+// profiling never stalls the pipeline: the GPU passes of a frame appear once gpu_resolved_ is set. A frame whose queries
+// are still pending by then loses its GPU times instead of waiting. The null backend only produces CPU scopes.
+class FrameProfiler
+{
+public:
+	static constexpr uint32_t kFrameLatency = 3;
+	static constexpr uint32_t kMaxPassesPerFrame = 64;
+	static constexpr uint32_t kMaxFrameHistory = 256;
+
+	// Times are in milliseconds since the profiler was created; GPU times are moved to the same clock.
+	struct CpuScope
+	{
+		std::string name_;
+		uint32_t thread_;
+		double start_ms_;
+		double duration_ms_;
+	};
+
+	struct GpuPass
+	{
+		// Position of the pass in the frame and the render pass it rendered to.
+		uint32_t index_;
+		ResourceHandle render_pass_;
+		double start_ms_;
+		double duration_ms_;
+	};
+
+	struct FrameTimings
+	{
+		uint64_t frame_ = 0;
+		std::vector<CpuScope> cpu_scopes_;
+		std::vector<GpuPass> gpu_passes_;
+		bool gpu_resolved_ = false;
+	};
+
+	FrameProfiler();
+	~FrameProfiler();
+
+	FrameProfiler(const FrameProfiler&) = delete;
+	FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+	// Disabled by default, scopes and passes are then ignored.
+	void SetEnabled(bool enabled) { enabled_ = enabled; }
+	bool IsEnabled() const { return enabled_; }
+
+	double GetTimeMs() const;
+	// Thread safe.
+	void AddCpuScope(const std::string& name, double start_ms, double end_ms);
+
+	// Called while replaying BeginPass and EndPass on the GL backend.
+	void BeginGpuPass(ResourceHandle render_pass);
+	void EndGpuPass();
+	// Called at the end of ExecuteCommandBuffers.
+	void EndFrame();
+
+	// Oldest first, at most kMaxFrameHistory frames.
+	const std::deque<FrameTimings>& GetFrames() const { return frames_; }
+	// Writes the frame history in the Chrome trace event format, viewable in chrome://tracing or Perfetto. CPU scopes are
+	// grouped by thread, GPU passes on a track of their own. Throws std::runtime_error when the file can't be written.
+	void WriteChromeTrace(const std::string& file_path) const;
+
+protected:
+	struct QueryFrame
+	{
+		GLuint queries_[kMaxPassesPerFrame * 2] = {};
+		std::vector<GpuPass> passes_;
+		uint64_t frame_ = 0;
+		// Clocks read together when the first query of the frame was issued.
+		double cpu_reference_ms_ = 0.0;
+		GLint64 gpu_reference_ns_ = 0;
+		bool pending_ = false;
+	};
+
+	void ResolveQueries(QueryFrame& query_frame);
+
+	bool enabled_ = false;
+	std::chrono::steady_clock::time_point epoch_;
+	std::mutex scope_mutex_;
+	std::vector<CpuScope> scopes_;
+	std::deque<FrameTimings> frames_;
+	uint64_t frame_ = 0;
+
+	QueryFrame query_frames_[kFrameLatency];
+	bool queries_created_ = false;
+	bool pass_open_ = false;
+};
+
+// Times the enclosing block into a CPU scope of the profiler. name must outlive the scope; it is only copied when the
+// profiler is enabled, so a disabled scope costs one branch.
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler& profiler, const char* name) :
+		profiler_(profiler),
+		name_(name),
+		start_ms_(profiler.IsEnabled()
+		          ? profiler.GetTimeMs()
+		          : -1.0) {}
+
+	~ProfileScope() { if (start_ms_ >= 0.0) { profiler_.AddCpuScope(name_, start_ms_, profiler_.GetTimeMs()); } }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+protected:
+	FrameProfiler& profiler_;
+	const char* name_;
+	double start_ms_;
+};
+
 class DeviceState
 {
 public:
-	void Apply();
+	void Apply(GlStateCache& gl_state);
+	// Declares the accesses of the draw or dispatch about to be issued and emits the barrier it needs. indirect_buffer
+	// is the buffer an indirect draw reads its arguments from, 0 otherwise.
+	void ApplyBarriers(BarrierTracker& barriers, bool indexed, GLuint indirect_buffer = 0) const;
 
-	const Viewport* viewport_;
-	const Rect2D* scissor_;
+	// Copied out of the commands: command data lives in the command buffer's arena, which is reset after submission.
+	Viewport viewport_;
+	Rect2D scissor_;
+	bool viewport_flag_ = false;
+	bool scissor_flag_ = false;
 	const Pipeline* pipeline_;
-	std::vector<const ResourceList*> resource_lists_;
-	std::vector<uint32_t> resource_offsets_;
+	const ResourceList* resource_lists_[kMaxResourceLists];
+	uint32_t resource_offsets_[kMaxResourceListOffsets];
+	uint32_t num_lists_;
+	uint32_t num_offsets_;
 
 	glm::vec4 clear_color_value_;
 	float clear_depth_value_;
@@ -484,6 +1287,7 @@ public:
 	bool clear_stencil_flag_;
 	GLuint fbo_handle_;
 	GLuint index_buffer_handle_;
+	IndexFormat index_format_ = IndexFormat::Uint16;
 
 	struct VertexBufferBinding
 	{
@@ -492,59 +1296,376 @@ public:
 		uint32_t offset_;
 	};
 
-	std::vector<VertexBufferBinding> vertex_buffer_bindings_;
-	uint32_t vertex_streams_num_;
+	VertexBufferBinding vertex_buffer_bindings_[kMaxVertexStreams];
 
 	bool swapchain_flag_;
 	bool end_pass_flag_;
+
+protected:
+	void ApplyResourceLists(GlStateCache& gl_state) const;
 };
 
+class RingBuffer;
+
 class Device
 {
 public:
-	std::shared_ptr<Texture> CreateTexture(const TextureCreation& creation) { return std::make_shared<Texture>(); }
+	// Work seen by the null backend during the last ExecuteCommandBuffers. A state change is a bind whose handle or
+	// value differs from the one bound before.
+	struct NullStats
+	{
+		uint32_t commands_ = 0;
+		uint32_t draws_ = 0;
+		// Indirect commands, each counts its draw_count in draws_.
+		uint32_t indirect_calls_ = 0;
+		uint32_t dispatches_ = 0;
+		uint32_t state_changes_ = 0;
+		uint32_t invalid_handles_ = 0;
+	};
 
-	std::shared_ptr<ResourceListLayout> CreateResourceListLayout(const ResourceListLayoutCreation& creation)
+	explicit Device(DeviceBackend backend = DeviceBackend::kOpenGL);
+	~Device();
+
+	Device(const Device&) = delete;
+	Device& operator=(const Device&) = delete;
+
+	DeviceBackend GetBackend() const { return backend_; }
+
+	ResourceHandle CreateTexture(const TextureCreation& creation);
+	ResourceHandle CreateResourceListLayout(const ResourceListLayoutCreation& creation);
+	ResourceHandle CreateBuffer(const BufferCreation& creation);
+	ResourceHandle CreateResourceList(const ResourceListCreation& creation);
+	// Replaces the bindings of an existing list, keeping its handle valid for whoever holds it.
+	void UpdateResourceList(ResourceHandle handle, const ResourceListCreation& creation);
+	// Bound with kSampler resource list items, on the texture unit given as their binding. A sampler stays bound to its
+	// unit until another list binds one there.
+	ResourceHandle CreateSampler(const SamplerCreation& creation);
+	// Returns the existing pipeline when one was created from an equal creation, and shares programs and vertex arrays
+	// between pipelines that only differ in the rest of their state. Each call must be matched by a DestroyPipeline.
+	// Throws std::runtime_error when a shader fails to compile or link.
+	ResourceHandle CreatePipeline(const PipelineCreation& creation);
+	// Command buffers are pooled per recording thread. Threads can reset and record concurrently as long as each uses
+	// its own thread_index. Only call SetRecordingThreadCount while no thread is recording.
+	void SetRecordingThreadCount(uint32_t thread_count);
+	// Hands out a command buffer of the thread's pool that is not queued or held elsewhere, rewound and ready for
+	// recording. Buffers are recycled, so their arenas are only allocated the first few frames.
+	std::shared_ptr<CommandBuffer> ResetCommandBuffer(uint32_t thread_index = 0);
+	// Thread safe.
+	void QueueCommandBuffer(const std::shared_ptr<CommandBuffer>& command_buffer);
+	// Merges the queued command buffers into one submission ordered by sort key, replays it and empties the queue.
+	// Submits are ordered against each other by the pass given to BeginSubmit. GL thread only, that is the thread
+	// which created the device.
+	void ExecuteCommandBuffers();
+	// GL calls made and filtered by the state cache during the last ExecuteCommandBuffers.
+	const GlStateCache::Stats& GetGlStateStats() const { return gl_state_cache_.GetStats(); }
+	const NullStats& GetNullStats() const { return null_stats_; }
+	// Since the device was created. A hit is a CreatePipeline call answered by an existing pipeline, program or vertex
+	// array instead of creating one.
+	struct PipelineCacheStats
 	{
-		return std::make_shared<ResourceListLayout>();
-	}
+		uint32_t pipeline_requests_ = 0;
+		uint32_t pipeline_hits_ = 0;
+		uint32_t program_requests_ = 0;
+		uint32_t program_hits_ = 0;
+		uint32_t vertex_array_requests_ = 0;
+		uint32_t vertex_array_hits_ = 0;
+	};
 
-	std::shared_ptr<Buffer> CreateBuffer(const BufferCreation& creation) { return std::make_shared<Buffer>(); }
-	std::shared_ptr<ResourceList> CreateResourceList(const ResourceListCreation& creation) { return std::make_shared<ResourceList>(); }
-	std::shared_ptr<Pipeline> CreatePipeline(const PipelineCreation& creation) { return std::make_shared<Pipeline>(); }
-	std::shared_ptr<CommandBuffer> ResetCommandBuffer() { return std::make_shared<CommandBuffer>(); }
+	const PipelineCacheStats& GetPipelineCacheStats() const { return pipeline_cache_stats_; }
+	// Memory barriers issued during the last ExecuteCommandBuffers, counted with any backend.
+	const BarrierTracker::Stats& GetBarrierStats() const { return barrier_tracker_.GetStats(); }
+
+	// Writes every command executed from now on to file_path, with any backend. Each ExecuteCommandBuffers call
+	// appends one frame: the executed records, packed as in a command buffer, serialized as a byte vector.
+	void StartCommandRecording(const std::string& file_path);
+	void StopCommandRecording();
+	// Saves the next executed frame and the resources it references as a FrameCapture.
+	void CaptureNextFrame(const std::string& file_path) { capture_path_ = file_path; }
+	// Executes packed command records in order as one frame, instead of the queued command buffers. Used to replay
+	// captures.
+	void ExecuteCommandRecords(const uint8_t* records, uint32_t size);
+
+	// Executes one command record. Called by CommandBuffer while replaying.
+	void ExecuteCommand(const CommandHeader& header);
+
+	void DestroyTexture(ResourceHandle handle);
+	void DestroyResourceListLayout(ResourceHandle handle);
+	void DestroyBuffer(ResourceHandle handle);
+	void DestroyResourceList(ResourceHandle handle);
+	void DestroySampler(ResourceHandle handle);
+	void DestroyPipeline(ResourceHandle handle);
 
 #pragma region AccessResource
 
 public:
-	Pipeline* AccessPipeline(uint32_t handle) { return static_cast<Pipeline*>(pipelines_.AccessResource(handle)); }
-	ResourceList* AccessResourceList(uint32_t handle) { return static_cast<ResourceList*>(resource_lists_.AccessResource(handle)); }
-	Buffer* AccessBuffer(uint32_t handle) { return static_cast<Buffer*>(buffers_.AccessResource(handle)); }
-	Texture* AccessTexture(uint32_t handle) { return static_cast<Texture*>(textures_.AccessResource(handle)); }
-	Shader* AccessShader(uint32_t handle) { return static_cast<Shader*>(shaders_.AccessResource(handle)); }
+	Pipeline* AccessPipeline(ResourceHandle handle) { return pipelines_.AccessResource(handle); }
+	ResourceList* AccessResourceList(ResourceHandle handle) { return resource_lists_.AccessResource(handle); }
+	Buffer* AccessBuffer(ResourceHandle handle) { return buffers_.AccessResource(handle); }
+	Texture* AccessTexture(ResourceHandle handle) { return textures_.AccessResource(handle); }
+	Shader* AccessShader(ResourceHandle handle) { return shaders_.AccessResource(handle); }
+	ResourceListLayout* AccessResourceListLayout(ResourceHandle handle) { return resource_list_layouts_.AccessResource(handle); }
+	CommandBuffer* AccessCommandBuffer(ResourceHandle handle) { return command_buffers_.AccessResource(handle); }
+	Sampler* AccessSampler(ResourceHandle handle) { return samplers_.AccessResource(handle); }
+	RenderPass* AccessRenderPass(ResourceHandle handle) { return render_passes_.AccessResource(handle); }
+
+protected:
+	ResourcePool<Buffer> buffers_;
+	ResourcePool<Texture> textures_;
+	ResourcePool<Pipeline> pipelines_;
+	ResourcePool<Sampler> samplers_;
+	ResourcePool<ResourceListLayout> resource_list_layouts_;
+	ResourcePool<ResourceList> resource_lists_;
+	ResourcePool<RenderPass> render_passes_;
+	ResourcePool<CommandBuffer> command_buffers_;
+	ResourcePool<Shader> shaders_;
+#pragma endregion
 
-	ResourceListLayout* AccessResourceListLayout(uint32_t handle)
+	std::vector<std::vector<std::shared_ptr<CommandBuffer>>> command_buffer_pools_ = std::vector<std::vector<std::shared_ptr<CommandBuffer>>>(1);
+	std::mutex queue_mutex_;
+	std::vector<std::shared_ptr<CommandBuffer>> queued_command_buffers_;
+	std::vector<std::shared_ptr<CommandBuffer>> executing_command_buffers_;
+	struct MergeCursor
 	{
-		return static_cast<ResourceListLayout*>(resource_list_layouts_.AccessResource(handle));
+		uint64_t key_;
+		uint32_t order_;
+		uint32_t buffer_;
+		uint32_t unit_;
+		uint32_t end_;
+	};
+
+	std::vector<MergeCursor> merge_heap_;
+	void ResetFrameStats();
+	// Merges and replays executing_command_buffers_.
+	void ExecuteQueuedCommandBuffers();
+	std::thread::id gl_thread_id_ = std::this_thread::get_id();
+
+	struct GlObjectCacheEntry
+	{
+		GLuint gl_handle_;
+		uint32_t references_;
+		// Of the pipeline that created the object, to tell hash collisions from hits.
+		PipelineCreation creation_;
+	};
+
+	void FillResourceList(ResourceList& resource_list, const ResourceListCreation& creation);
+
+	// hash is updated to the cache key the object is stored under, which differs from it on hash collisions.
+	GLuint AcquireProgram(const PipelineCreation& creation, uint64_t& hash);
+	GLuint AcquireVertexArray(const PipelineCreation& creation, uint64_t& hash);
+	void ReleaseProgram(uint64_t hash);
+	void ReleaseVertexArray(uint64_t hash);
+
+	std::unordered_map<uint64_t, ResourceHandle> pipeline_cache_;
+	std::unordered_map<uint64_t, GlObjectCacheEntry> program_cache_;
+	std::unordered_map<uint64_t, GlObjectCacheEntry> vertex_array_cache_;
+	PipelineCacheStats pipeline_cache_stats_;
+
+	void ExecuteNullCommand(const CommandHeader& header);
+	bool ValidateNullHandle(bool valid);
+	void TrackNullBarriers(bool graphics, bool indexed, ResourceHandle indirect_buffer = kInvalidHandle);
+
+	template <typename T>
+	void TrackNullState(T& bound, const T& value)
+	{
+		if (bound == value) { return; }
+		bound = value;
+		++null_stats_.state_changes_;
 	}
 
-	CommandBuffer* AccessCommandBuffer(uint32_t handle) { return static_cast<CommandBuffer*>(command_buffers_.AccessResource(handle)); }
-	Sampler* AccessSampler(uint32_t handle) { return static_cast<Sampler*>(samplers_.AccessResource(handle)); }
-	RenderPass* AccessRenderPass(uint32_t handle) { return static_cast<RenderPass*>(render_passes_.AccessResource(handle)); }
+	DeviceBackend backend_;
+	GLuint next_null_gl_name_ = 1;
+	NullStats null_stats_;
+	// Bound state seen by the null backend.
+	ResourceHandle null_pipeline_ = kInvalidHandle;
+	ResourceHandle null_resource_lists_[kMaxResourceLists];
+	uint32_t null_num_lists_ = 0;
+	ResourceHandle null_index_buffer_ = kInvalidHandle;
+	ResourceHandle null_vertex_buffers_[kMaxVertexStreams];
+	glm::vec4 null_viewport_ = glm::vec4(-1.0f);
+	glm::vec4 null_scissor_ = glm::vec4(-1.0f);
 
-protected:
-	ResourcePool buffers_;
-	ResourcePool textures_;
-	ResourcePool pipelines_;
-	ResourcePool samplers_;
-	ResourcePool resource_list_layouts_;
-	ResourcePool resource_lists_;
-	ResourcePool render_passes_;
-	ResourcePool command_buffers_;
-	ResourcePool shaders_;
-#pragma endregion
+	std::unique_ptr<BinarySerializer> command_recording_;
+	std::string capture_path_;
+	std::vector<uint8_t> recorded_frame_;
+
+	friend class FrameCapture;
+
+	friend class RingBuffer;
+	std::vector<RingBuffer*> ring_buffers_;
 
 public:
 	DeviceState device_state_; //TODO hide
+	GlStateCache gl_state_cache_;
+	BarrierTracker barrier_tracker_;
+	FrameProfiler profiler_;
 };
-}
+
+// Persistent worker threads recording command buffers in parallel. Each thread records into a buffer of its own
+// device pool, the buffers are queued on the device when Record returns and merged by sort key at execution.
+// Recording never touches GL, so record functions must only fill the command buffer they are given.
+class CommandRecorder
+{
+public:
+	using RecordFunction = std::function<void(CommandBuffer& command_buffer, uint32_t job_index)>;
+
+	// thread_count includes the calling thread, 0 uses the hardware concurrency.
+	explicit CommandRecorder(Device& device, uint32_t thread_count = 0);
+	~CommandRecorder();
+
+	CommandRecorder(const CommandRecorder&) = delete;
+	CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+	// Runs record for job indices [0, job_count) across the workers and the calling thread and waits for all of them.
+	// Jobs that share a thread are recorded into the same buffer; each job should wrap its draws in a submit, which is
+	// sorted and merged with the submits of every other job.
+	void Record(uint32_t job_count, const RecordFunction& record);
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers_.size()) + 1; }
+
+protected:
+	void WorkerMain(uint32_t thread_index);
+	void RunJobs(uint32_t thread_index);
+
+	Device& device_;
+	std::vector<std::thread> workers_;
+	std::vector<std::shared_ptr<CommandBuffer>> thread_command_buffers_;
+
+	std::mutex mutex_;
+	std::condition_variable work_condition_;
+	std::condition_variable done_condition_;
+	const RecordFunction* record_ = nullptr;
+	uint32_t job_count_ = 0;
+	std::atomic<uint32_t> next_job_{0};
+	uint64_t generation_ = 0;
+	uint32_t busy_workers_ = 0;
+	bool stop_ = false;
+};
+
+// Per-frame dynamic data, such as per-draw constants, sub-allocated from one large buffer. Allocations are aligned for
+// uniform buffer ranges and stay valid until the frame is executed: bind the buffer in a resource list and pass the
+// allocation offset as the dynamic offset of the draw.
+//
+// With GL 4.4 the buffer is persistently and coherently mapped and allocations are written in place. Otherwise they
+// are staged in memory and uploaded with one glBufferSubData per contiguous range before the frame executes. The
+// device fences the range of every executed frame, and allocating over a range the GPU may still read waits for its
+// fence. Not thread safe, use one ring per recording thread.
+class RingBuffer
+{
+public:
+	struct Allocation
+	{
+		void* data_;
+		uint32_t offset_;
+	};
+
+	// Since the ring was created. A fence wait is an allocation that had to block on the GPU.
+	struct Stats
+	{
+		uint32_t allocations_ = 0;
+		uint64_t allocated_bytes_ = 0;
+		uint32_t uploads_ = 0;
+		uint32_t fence_waits_ = 0;
+	};
+
+	static constexpr uint32_t kDefaultSize = 4 * 1024 * 1024;
+
+	explicit RingBuffer(Device& device, uint32_t size = kDefaultSize);
+	~RingBuffer();
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	// Throws std::runtime_error when a single frame allocates more than the ring holds.
+	Allocation Allocate(uint32_t size);
+
+	// Copies value into a new allocation and returns its offset.
+	template <typename T>
+	uint32_t Push(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Ring buffer data is copied as bytes");
+		const Allocation allocation = Allocate(sizeof(T));
+		std::memcpy(allocation.data_, &value, sizeof(T));
+		return allocation.offset_;
+	}
+
+	ResourceHandle GetBuffer() const { return buffer_; }
+	bool IsPersistentlyMapped() const { return mapped_data_ != nullptr; }
+	const Stats& GetStats() const { return stats_; }
+
+protected:
+	friend class Device;
+
+	static constexpr uint64_t kFenceTimeout = 1000000000;
+
+	struct Frame
+	{
+		GLsync fence_;
+		uint64_t end_;
+	};
+
+	// Called by Device::ExecuteCommandBuffers before and after the replay.
+	void Upload();
+	void Fence();
+	void RetireOldestFrame();
+
+	Device& device_;
+	ResourceHandle buffer_ = kInvalidHandle;
+	uint32_t size_ = 0;
+	uint32_t alignment_ = 256;
+	uint8_t* mapped_data_ = nullptr;
+	std::vector<uint8_t> staging_;
+	// Absolute byte positions, the ring offset is the position modulo size_. head_ ends the last allocation, tail_ the
+	// oldest range the GPU may still read and upload_ the staged data already uploaded.
+	uint64_t head_ = 0;
+	uint64_t tail_ = 0;
+	uint64_t upload_ = 0;
+	std::deque<Frame> frames_;
+	Stats stats_;
+};
+
+// Packs indexed draws into indirect arguments and records each run of compatible draws as one multi-draw. Draws are
+// compatible when they share pipeline, resource list, vertex buffer and index buffer, i.e. meshes sub-allocated from
+// shared buffers; the vertex buffer is bound at binding 0. Shaders tell the draws of a batch apart with gl_DrawID or
+// the first instance. The arguments are written to a RingBuffer, which uploads and fences them with the frame.
+class IndirectDrawBuilder
+{
+public:
+	struct Stats
+	{
+		uint32_t draws_ = 0;
+		uint32_t batches_ = 0;
+	};
+
+	void Reset() { draws_.clear(); }
+	void AddDraw(ResourceHandle pipeline, ResourceHandle resource_list, ResourceHandle vertex_buffer, ResourceHandle index_buffer,
+		const DrawElementsIndirectArguments& arguments);
+	// Groups the draws added since Reset by state and records them. Draws keep their order within a batch.
+	void Record(CommandBuffer& command_buffer, RingBuffer& ring_buffer);
+
+	// Of the last Record.
+	const Stats& GetStats() const { return stats_; }
+
+protected:
+	struct Draw
+	{
+		ResourceHandle pipeline_;
+		ResourceHandle resource_list_;
+		ResourceHandle vertex_buffer_;
+		ResourceHandle index_buffer_;
+		DrawElementsIndirectArguments arguments_;
+	};
+
+	std::vector<Draw> draws_;
+	std::vector<uint32_t> order_;
+	Stats stats_;
+};
+
+// Records a synthetic 50k draw frame on a null device, on one thread and on a CommandRecorder, and reports timings
+// and state changes before and after sorting, then the cost of per-draw constants through a RingBuffer and of the
+// same draws batched by an IndirectDrawBuilder. Runs without a GL context.
+void BenchmarkCommandSort();
+
+// Records the same jobs serially and on CommandRecorders of 2, 4 and 8 threads, over several frames, and checks that
+// every recording executes the same draws with the same state changes as the serial one. Runs without a GL context.
+void TestCommandRecorder();
+}
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "HFX/HFX.h"
+
+namespace graphics
+{
+//
+// Bytes per pixel of the formats used by the renderer, 4 for the rest.
+//
+static uint32_t GetTextureFormatSize(TextureFormat format)
+{
+	switch (format)
+	{
+		case TextureFormat::R32G32B32A32_FLOAT: return 16;
+		case TextureFormat::R16G16B16A16_FLOAT: return 8;
+		case TextureFormat::R8_UNORM: return 1;
+		default: return 4;
+	}
+}
+
+RenderGraph::~RenderGraph()
+{
+	for (const Pass& pass : passes_) { device_.DestroyResourceList(pass.resource_list_); }
+	for (const PhysicalResource& physical : physical_resources_)
+	{
+		if (physical.texture_) { device_.DestroyTexture(physical.handle_); }
+		else { device_.DestroyBuffer(physical.handle_); }
+	}
+}
+
+uint32_t RenderGraph::AddResource(const std::string& name)
+{
+	if (resource_lookup_.count(name)) { throw std::runtime_error("Render graph resource declared twice: " + name); }
+	resource_lookup_[name] = static_cast<uint32_t>(resources_.size());
+	resources_.emplace_back();
+	resources_.back().name_ = name;
+	return static_cast<uint32_t>(resources_.size() - 1);
+}
+
+uint32_t RenderGraph::FindResource(const std::string& name) const
+{
+	const auto it = resource_lookup_.find(name);
+	if (it == resource_lookup_.end()) { throw std::runtime_error("Render graph resource not declared: " + name); }
+	return it->second;
+}
+
+void RenderGraph::DeclareTexture(const std::string& name, uint32_t width, uint32_t height, TextureFormat format)
+{
+	Resource& resource = resources_[AddResource(name)];
+	resource.width_ = width;
+	resource.height_ = height;
+	resource.format_ = format;
+}
+
+void RenderGraph::DeclareBuffer(const std::string& name, BufferType type, uint32_t size)
+{
+	Resource& resource = resources_[AddResource(name)];
+	resource.texture_ = false;
+	resource.buffer_type_ = type;
+	resource.size_ = size;
+}
+
+void RenderGraph::ImportTexture(const std::string& name, ResourceHandle texture)
+{
+	Resource& resource = resources_[AddResource(name)];
+	resource.imported_ = true;
+	resource.handle_ = texture;
+}
+
+void RenderGraph::ImportBuffer(const std::string& name, ResourceHandle buffer)
+{
+	Resource& resource = resources_[AddResource(name)];
+	resource.texture_ = false;
+	resource.imported_ = true;
+	resource.handle_ = buffer;
+}
+
+void RenderGraph::MarkOutput(const std::string& name) { resources_[FindResource(name)].output_ = true; }
+
+uint32_t RenderGraph::AddPass(const std::string& name, PassType type, std::vector<std::string> reads, std::vector<std::string> writes,
+	ExecuteFunction execute)
+{
+	passes_.emplace_back();
+	Pass& pass = passes_.back();
+	pass.name_ = name;
+	pass.type_ = type;
+	pass.read_names_ = std::move(reads);
+	pass.write_names_ = std::move(writes);
+	pass.execute_ = std::move(execute);
+	return static_cast<uint32_t>(passes_.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const HFX::ShaderEffect& effect, const HFX::Pass& pass, ExecuteFunction execute)
+{
+	std::vector<std::string> reads;
+	std::vector<std::string> writes;
+	std::vector<Binding> bindings;
+	for (int resource_list_ref : pass.resource_list_refs_)
+	{
+		for (const HFX::ResourceBinding& resource : effect.resource_lists_[resource_list_ref].resources_)
+		{
+			const bool written = resource.type_ == ResourceType::kTextureRW || resource.type_ == ResourceType::kBufferRW;
+			(written
+			 ? writes
+			 : reads).push_back(resource.name_);
+			bindings.push_back({resource.type_, resource.name_});
+		}
+	}
+	const uint32_t index = AddPass(pass.name_, pass.type_, std::move(reads), std::move(writes), std::move(execute));
+	passes_[index].bindings_ = std::move(bindings);
+	return index;
+}
+
+void RenderGraph::Compile()
+{
+	ResolvePasses();
+	CullPasses();
+	SortPasses();
+	AliasResources();
+	UpdateResourceLists();
+}
+
+void RenderGraph::ResolvePasses()
+{
+	for (Resource& resource : resources_) { resource.writers_.clear(); }
+	for (uint32_t p = 0; p < passes_.size(); ++p)
+	{
+		Pass& pass = passes_[p];
+		pass.reads_.clear();
+		pass.writes_.clear();
+		for (const std::string& name : pass.read_names_) { pass.reads_.push_back(FindResource(name)); }
+		for (const std::string& name : pass.write_names_)
+		{
+			const uint32_t resource = FindResource(name);
+			pass.writes_.push_back(resource);
+			resources_[resource].writers_.push_back(p);
+		}
+	}
+}
+
+void RenderGraph::CullPasses()
+{
+	std::vector<uint32_t> pending;
+	for (uint32_t p = 0; p < passes_.size(); ++p)
+	{
+		Pass& pass = passes_[p];
+		pass.live_ = pass.writes_.empty();
+		for (uint32_t resource : pass.writes_) { pass.live_ |= resources_[resource].imported_ || resources_[resource].output_; }
+		if (pass.live_) { pending.push_back(p); }
+	}
+
+	// Everything a live pass reads is live.
+	while (!pending.empty())
+	{
+		const uint32_t p = pending.back();
+		pending.pop_back();
+		for (uint32_t resource : passes_[p].reads_)
+		{
+			for (uint32_t writer : resources_[resource].writers_)
+			{
+				if (passes_[writer].live_) { continue; }
+				passes_[writer].live_ = true;
+				pending.push_back(writer);
+			}
+		}
+	}
+}
+
+void RenderGraph::SortPasses()
+{
+	// Edges: every write of a resource before any of its reads, and writes of the same resource in declaration order.
+	const uint32_t pass_count = static_cast<uint32_t>(passes_.size());
+	std::vector<std::vector<uint32_t>> successors(pass_count);
+	std::vector<uint32_t> dependency_counts(pass_count, 0);
+	const auto add_edge = [&](uint32_t from, uint32_t to)
+	{
+		if (from == to || !passes_[from].live_ || !passes_[to].live_) { return; }
+		successors[from].push_back(to);
+		++dependency_counts[to];
+	};
+	for (uint32_t p = 0; p < pass_count; ++p)
+	{
+		for (uint32_t resource : passes_[p].reads_) { for (uint32_t writer : resources_[resource].writers_) { add_edge(writer, p); } }
+	}
+	for (const Resource& resource : resources_)
+	{
+		for (size_t i = 1; i < resource.writers_.size(); ++i) { add_edge(resource.writers_[i - 1], resource.writers_[i]); }
+	}
+
+	// Kahn's algorithm, picking the ready pass declared first so independent passes keep their declaration order.
+	std::vector<uint32_t> ready;
+	for (uint32_t p = 0; p < pass_count; ++p) { if (passes_[p].live_ && dependency_counts[p] == 0) { ready.push_back(p); } }
+	execution_order_.clear();
+	while (!ready.empty())
+	{
+		const auto first = std::min_element(ready.begin(), ready.end());
+		const uint32_t p = *first;
+		ready.erase(first);
+		execution_order_.push_back(p);
+		for (uint32_t successor : successors[p]) { if (--dependency_counts[successor] == 0) { ready.push_back(successor); } }
+	}
+
+	uint32_t live_count = 0;
+	for (const Pass& pass : passes_) { live_count += pass.live_; }
+	if (execution_order_.size() != live_count) { throw std::runtime_error("Render graph has a dependency cycle"); }
+
+	stats_.passes_ = live_count;
+	stats_.culled_passes_ = pass_count - live_count;
+}
+
+uint64_t RenderGraph::GetResourceBytes(const Resource& resource) const
+{
+	return resource.texture_
+	       ? static_cast<uint64_t>(resource.width_) * resource.height_ * GetTextureFormatSize(resource.format_)
+	       : resource.size_;
+}
+
+void RenderGraph::AliasResources()
+{
+	for (Resource& resource : resources_) { resource.first_use_ = resource.last_use_ = kNone; }
+	for (uint32_t position = 0; position < execution_order_.size(); ++position)
+	{
+		const Pass& pass = passes_[execution_order_[position]];
+		for (const std::vector<uint32_t>* used : {&pass.reads_, &pass.writes_})
+		{
+			for (uint32_t r : *used)
+			{
+				Resource& resource = resources_[r];
+				if (resource.first_use_ == kNone) { resource.first_use_ = position; }
+				resource.last_use_ = position;
+			}
+		}
+	}
+
+	std::vector<uint32_t> transients;
+	for (uint32_t r = 0; r < resources_.size(); ++r)
+	{
+		Resource& resource = resources_[r];
+		if (resource.imported_) { continue; }
+		resource.handle_ = kInvalidHandle;
+		if (resource.first_use_ != kNone) { transients.push_back(r); }
+	}
+	std::sort(transients.begin(), transients.end(),
+		[this](uint32_t a, uint32_t b) { return resources_[a].first_use_ < resources_[b].first_use_; });
+
+	// Greedy interval assignment: a physical resource is reused by the next compatible transient once its previous user
+	// is done. Buffers take the smallest free buffer large enough.
+	for (PhysicalResource& physical : physical_resources_) { physical.busy_until_ = kNone; }
+	stats_.transient_resources_ = static_cast<uint32_t>(transients.size());
+	stats_.transient_bytes_ = 0;
+	for (uint32_t r : transients)
+	{
+		Resource& resource = resources_[r];
+		stats_.transient_bytes_ += GetResourceBytes(resource);
+
+		PhysicalResource* best = nullptr;
+		for (PhysicalResource& physical : physical_resources_)
+		{
+			if (physical.texture_ != resource.texture_) { continue; }
+			if (physical.busy_until_ != kNone && physical.busy_until_ >= resource.first_use_) { continue; }
+			if (resource.texture_)
+			{
+				if (physical.width_ != resource.width_ || physical.height_ != resource.height_ || physical.format_ != resource.format_) { continue; }
+			}
+			else if (physical.buffer_type_ != resource.buffer_type_ || physical.size_ < resource.size_ || (best && best->size_ <= physical.size_))
+			{
+				continue;
+			}
+			best = &physical;
+			if (resource.texture_) { break; }
+		}
+
+		if (!best)
+		{
+			PhysicalResource physical;
+			physical.texture_ = resource.texture_;
+			physical.width_ = resource.width_;
+			physical.height_ = resource.height_;
+			physical.format_ = resource.format_;
+			physical.buffer_type_ = resource.buffer_type_;
+			physical.size_ = resource.size_;
+			physical.handle_ = resource.texture_
+			                   ? device_.CreateTexture(TextureCreation(resource.width_, resource.height_, resource.format_, resource.name_))
+			                   : device_.CreateBuffer(BufferCreation(resource.buffer_type_, ResourceUsageType::Dynamic, resource.size_, resource.name_));
+			physical_resources_.push_back(physical);
+			best = &physical_resources_.back();
+		}
+		best->busy_until_ = resource.last_use_;
+		resource.handle_ = best->handle_;
+	}
+
+	// Physical resources nothing maps to after this compile are released.
+	stats_.physical_resources_ = 0;
+	stats_.physical_bytes_ = 0;
+	for (auto it = physical_resources_.begin(); it != physical_resources_.end();)
+	{
+		if (it->busy_until_ != kNone)
+		{
+			Resource described;
+			described.texture_ = it->texture_;
+			described.width_ = it->width_;
+			described.height_ = it->height_;
+			described.format_ = it->format_;
+			described.size_ = it->size_;
+			++stats_.physical_resources_;
+			stats_.physical_bytes_ += GetResourceBytes(described);
+			++it;
+			continue;
+		}
+		if (it->texture_) { device_.DestroyTexture(it->handle_); }
+		else { device_.DestroyBuffer(it->handle_); }
+		it = physical_resources_.erase(it);
+	}
+}
+
+void RenderGraph::UpdateResourceLists()
+{
+	for (Pass& pass : passes_)
+	{
+		if (!pass.live_ || pass.bindings_.empty())
+		{
+			device_.DestroyResourceList(pass.resource_list_);
+			pass.resource_list_ = kInvalidHandle;
+			continue;
+		}
+
+		ResourceListCreation creation;
+		for (uint32_t i = 0; i < pass.bindings_.size(); ++i)
+		{
+			const Binding& binding = pass.bindings_[i];
+			creation.Add(binding.type_, resources_[FindResource(binding.name_)].handle_, i);
+		}
+		if (pass.resource_list_ == kInvalidHandle) { pass.resource_list_ = device_.CreateResourceList(creation); }
+		else { device_.UpdateResourceList(pass.resource_list_, creation); }
+	}
+}
+
+void RenderGraph::Execute(CommandBuffer& command_buffer) const
+{
+	for (uint32_t position = 0; position < execution_order_.size(); ++position)
+	{
+		const Pass& pass = passes_[execution_order_[position]];
+		ProfileScope scope(device_.profiler_, pass.name_.c_str());
+		command_buffer.BeginSubmit(static_cast<uint8_t>(std::min<uint32_t>(position, UINT8_MAX)));
+		pass.execute_(command_buffer, pass.resource_list_);
+		command_buffer.EndSubmit();
+	}
+}
+
+ResourceHandle RenderGraph::GetTexture(const std::string& name) const { return resources_[FindResource(name)].handle_; }
+
+ResourceHandle RenderGraph::GetBuffer(const std::string& name) const { return resources_[FindResource(name)].handle_; }
+}
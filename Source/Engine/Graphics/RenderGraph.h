@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Graphics.h"
+
+namespace HFX
+{
+class ShaderEffect;
+struct Pass;
+}
+
+namespace graphics
+{
+// Frame graph of passes declaring the named resources they read and write.
+//
+// Compile culls the passes whose writes nobody needs, orders the rest so every read of a resource follows all of its
+// writes, and backs transient resources with pooled physical ones: transients whose lifetimes do not overlap share the
+// same texture or buffer. Physical resources survive recompiles and are only created or destroyed when the graph
+// changes. A pass keeps its resource list handle while it stays live, recompiles only rebind what the list points at,
+// so a frame costs one Execute.
+//
+// A pass writing nothing is assumed to write the backbuffer and is never culled. Imported resources and resources
+// marked as outputs keep their writers alive.
+class RenderGraph
+{
+public:
+	// resource_list holds the bindings of a pass added from HFX, kInvalidHandle otherwise.
+	using ExecuteFunction = std::function<void(CommandBuffer& command_buffer, ResourceHandle resource_list)>;
+
+	struct Stats
+	{
+		uint32_t passes_ = 0;
+		uint32_t culled_passes_ = 0;
+		uint32_t transient_resources_ = 0;
+		uint32_t physical_resources_ = 0;
+		// Memory of the transient resources if each had its own allocation, and once aliased.
+		uint64_t transient_bytes_ = 0;
+		uint64_t physical_bytes_ = 0;
+	};
+
+	explicit RenderGraph(Device& device) : device_(device) {}
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	void DeclareTexture(const std::string& name, uint32_t width, uint32_t height, TextureFormat format);
+	void DeclareBuffer(const std::string& name, BufferType type, uint32_t size);
+	void ImportTexture(const std::string& name, ResourceHandle texture);
+	void ImportBuffer(const std::string& name, ResourceHandle buffer);
+	void MarkOutput(const std::string& name);
+
+	// Returns the pass index. Resource names are resolved by Compile, so they can be declared in any order.
+	uint32_t AddPass(const std::string& name, PassType type, std::vector<std::string> reads, std::vector<std::string> writes,
+		ExecuteFunction execute);
+	// Reads and writes come from the resource lists of the pass: RW textures and buffers are written, everything else is
+	// read. The graph creates a resource list with the resources bound in declaration order.
+	uint32_t AddPass(const HFX::ShaderEffect& effect, const HFX::Pass& pass, ExecuteFunction execute);
+
+	// Throws std::runtime_error on undeclared resources and dependency cycles.
+	void Compile();
+	// Records the live passes in order, each in its own submit ranked by its position.
+	void Execute(CommandBuffer& command_buffer) const;
+
+	ResourceHandle GetTexture(const std::string& name) const;
+	ResourceHandle GetBuffer(const std::string& name) const;
+	const Stats& GetStats() const { return stats_; }
+	// Pass indices of the live passes, in execution order.
+	const std::vector<uint32_t>& GetExecutionOrder() const { return execution_order_; }
+
+protected:
+	static constexpr uint32_t kNone = 0xFFFFFFFF;
+
+	struct Resource
+	{
+		std::string name_;
+		bool texture_ = true;
+		bool imported_ = false;
+		bool output_ = false;
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		TextureFormat format_ = TextureFormat::UNKNOWN;
+		BufferType buffer_type_ = BufferType::Constant;
+		uint32_t size_ = 0;
+		ResourceHandle handle_ = kInvalidHandle;
+		// Execution positions of the first and last live pass using the resource.
+		uint32_t first_use_ = kNone;
+		uint32_t last_use_ = kNone;
+		std::vector<uint32_t> writers_;
+	};
+
+	struct Binding
+	{
+		ResourceType type_;
+		std::string name_;
+	};
+
+	struct Pass
+	{
+		std::string name_;
+		PassType type_;
+		std::vector<std::string> read_names_;
+		std::vector<std::string> write_names_;
+		std::vector<Binding> bindings_;
+		ExecuteFunction execute_;
+		std::vector<uint32_t> reads_;
+		std::vector<uint32_t> writes_;
+		ResourceHandle resource_list_ = kInvalidHandle;
+		bool live_ = false;
+	};
+
+	struct PhysicalResource
+	{
+		bool texture_;
+		uint32_t width_;
+		uint32_t height_;
+		TextureFormat format_;
+		BufferType buffer_type_;
+		uint32_t size_;
+		ResourceHandle handle_;
+		// Last execution position using the physical resource in the current compile, kNone while unused.
+		uint32_t busy_until_;
+	};
+
+	uint32_t AddResource(const std::string& name);
+	uint32_t FindResource(const std::string& name) const;
+	void ResolvePasses();
+	void CullPasses();
+	void SortPasses();
+	void AliasResources();
+	void UpdateResourceLists();
+	uint64_t GetResourceBytes(const Resource& resource) const;
+
+	Device& device_;
+	std::vector<Resource> resources_;
+	std::unordered_map<std::string, uint32_t> resource_lookup_;
+	std::vector<Pass> passes_;
+	std::vector<uint32_t> execution_order_;
+	std::vector<PhysicalResource> physical_resources_;
+	Stats stats_;
+};
+}
@@ -260,97 +260,27 @@ BinarySerializer& operator<<(BinarySerializer& serializer, std::shared_ptr<Prope
 	return serializer;
 }
 
-BinarySerializer& operator<<(BinarySerializer& serializer, IntProperty& int_property)
+// Calls func with property cast to the derived type its type_ selects.
+template <typename Func>
+static auto VisitDerivedProperty(const Property& property, Func&& func)
 {
-	serializer << int_property.default_value_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, FloatProperty& float_property)
-{
-	serializer << float_property.default_value_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, RangeProperty& range_property)
-{
-	serializer << range_property.min_value_;
-	serializer << range_property.max_value_;
-	serializer << range_property.default_value_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, TextureProperty& texture_property)
-{
-	serializer << texture_property.default_value_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, ResourceBinding& resource_binding)
-{
-	serializer << resource_binding.name_;
-	serializer << resource_binding.type_;
-	return serializer;
+	if (property.type_ == graphics::PropertyType::kFloat) { return func(static_cast<const FloatProperty&>(property)); }
+	if (property.type_ == graphics::PropertyType::kInt) { return func(static_cast<const IntProperty&>(property)); }
+	if (property.type_ == graphics::PropertyType::kRange) { return func(static_cast<const RangeProperty&>(property)); }
+	if (property.type_ == graphics::PropertyType::kTexture2D) { return func(static_cast<const TextureProperty&>(property)); }
+	throw std::runtime_error("Property type not supported");
 }
 
-BinarySerializer& operator<<(BinarySerializer& serializer, ResourceList& resource_list)
+uint64_t HashValue(const std::shared_ptr<Property>& property, uint64_t hash)
 {
-	serializer << resource_list.name_;
-	serializer << resource_list.resources_;
-	return serializer;
+	hash = reflection::HashValue(*property, hash);
+	return VisitDerivedProperty(*property, [hash](const auto& derived) { return reflection::HashValue(derived, hash); });
 }
 
-BinarySerializer& operator<<(BinarySerializer& serializer, RenderState& render_state)
+size_t SerializedSize(const std::shared_ptr<Property>& property)
 {
-	serializer << render_state.name_;
-	serializer << render_state.rasterization_state_;
-	serializer << render_state.depth_stencil_state_;
-	serializer << render_state.blend_state_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, Shader& shader)
-{
-	serializer << shader.type_;
-	serializer << shader.code_chunk_ref_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, Pass& pass)
-{
-	serializer << pass.name_;
-	serializer << pass.shaders_;
-	serializer << pass.resource_list_refs_;
-	serializer << pass.render_state_ref_;
-	serializer << pass.type_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, Resource& resource)
-{
-	serializer << resource.name_;
-	serializer << resource.type_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, CodeChunk& code_chunk)
-{
-	serializer << code_chunk.name_;
-	serializer << code_chunk.includes_;
-	serializer << code_chunk.resources_;
-	serializer << code_chunk.code_;
-	return serializer;
-}
-
-BinarySerializer& operator<<(BinarySerializer& serializer, ShaderEffect& shader_effect)
-{
-	serializer << shader_effect.name_;
-	serializer << shader_effect.passes_;
-	serializer << shader_effect.code_chunks_;
-	serializer << shader_effect.resource_lists_;
-	serializer << shader_effect.render_states_;
-	serializer << shader_effect.properties_;
-	return serializer;
+	return reflection::SerializedSize(*property) +
+	       VisitDerivedProperty(*property, [](const auto& derived) { return reflection::SerializedSize(derived); });
 }
 
 Lexer::Lexer(const std::string& source, DataBuffer& in_data_buffer): position_(source.c_str()), line_(1), column_(0), has_error_(false),
@@ -1276,7 +1206,7 @@ void CompileHFX(const std::string& file_path)
 	data_buffer.Print();
 
 	{
-		BinarySerializer serializer(SerializerAction::kWrite, "shader_effect.bin");
+		BinarySerializer serializer(SerializerAction::kWrite, "shader_effect.bin", SerializerMode::kAsync);
 		serializer << shader_effect;
 	}
 	ShaderEffect shader_effect2;
@@ -155,29 +155,37 @@ struct Token
 	}
 };
 
+// Serialized by hand: the fields below, then the fields of the derived type selected by type_. Pointers carry no null
+// flag, so HashValue and SerializedSize have matching overloads rather than the generic shared_ptr ones.
 struct Property
 {
 	std::string name_;
 	std::string ui_name_;
 	graphics::PropertyType type_;
 
+	SERIALIZE_FIELDS(&Property::name_, &Property::ui_name_, &Property::type_)
+
 	friend BinarySerializer& operator<<(BinarySerializer& serializer, Property& property);
 
 	friend BinarySerializer& operator<<(BinarySerializer& serializer, std::shared_ptr<Property>& property_ptr);
 };
 
+uint64_t HashValue(const std::shared_ptr<Property>& property, uint64_t hash = reflection::kHashSeed);
+
+size_t SerializedSize(const std::shared_ptr<Property>& property);
+
 struct IntProperty : Property
 {
 	int default_value_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, IntProperty& int_property);
+	SERIALIZE_FIELDS(&IntProperty::default_value_)
 };
 
 struct FloatProperty : Property
 {
 	float default_value_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, FloatProperty& float_property);
+	SERIALIZE_FIELDS(&FloatProperty::default_value_)
 };
 
 struct RangeProperty : Property
@@ -186,14 +194,14 @@ struct RangeProperty : Property
 	float max_value_;
 	float default_value_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, RangeProperty& range_property);
+	SERIALIZE_FIELDS(&RangeProperty::min_value_, &RangeProperty::max_value_, &RangeProperty::default_value_)
 };
 
 struct TextureProperty : Property
 {
 	std::string default_value_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, TextureProperty& texture_property);
+	SERIALIZE_FIELDS(&TextureProperty::default_value_)
 };
 
 struct ResourceBinding
@@ -201,7 +209,7 @@ struct ResourceBinding
 	std::string name_;
 	graphics::ResourceType type_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, ResourceBinding& resource_binding);
+	SERIALIZE_FIELDS(&ResourceBinding::name_, &ResourceBinding::type_)
 };
 
 struct ResourceList
@@ -209,7 +217,7 @@ struct ResourceList
 	std::string name_;
 	std::vector<ResourceBinding> resources_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, ResourceList& resource_list);
+	SERIALIZE_FIELDS(&ResourceList::name_, &ResourceList::resources_)
 };
 
 struct RenderState
@@ -219,7 +227,7 @@ struct RenderState
 	graphics::DepthStencilState depth_stencil_state_;
 	graphics::BlendState blend_state_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, RenderState& render_state);
+	SERIALIZE_FIELDS(&RenderState::name_, &RenderState::rasterization_state_, &RenderState::depth_stencil_state_, &RenderState::blend_state_)
 };
 
 struct Shader
@@ -227,7 +235,7 @@ struct Shader
 	graphics::ShaderType type_;
 	int code_chunk_ref_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, Shader& shader);
+	SERIALIZE_FIELDS(&Shader::type_, &Shader::code_chunk_ref_)
 };
 
 struct Pass
@@ -238,7 +246,7 @@ struct Pass
 	int render_state_ref_;
 	graphics::PassType type_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, Pass& pass);
+	SERIALIZE_FIELDS(&Pass::name_, &Pass::shaders_, &Pass::resource_list_refs_, &Pass::render_state_ref_, &Pass::type_)
 };
 
 struct Resource
@@ -246,7 +254,7 @@ struct Resource
 	graphics::ResourceType type_;
 	std::string name_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, Resource& resource);
+	SERIALIZE_FIELDS(&Resource::name_, &Resource::type_)
 };
 
 struct CodeChunk
@@ -256,7 +264,7 @@ struct CodeChunk
 	std::vector<Resource> resources_; // represent the resource layout
 	std::string code_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, CodeChunk& code_chunk);
+	SERIALIZE_FIELDS(&CodeChunk::name_, &CodeChunk::includes_, &CodeChunk::resources_, &CodeChunk::code_)
 };
 
 class ShaderEffect
@@ -269,7 +277,8 @@ public:
 	std::vector<RenderState> render_states_;
 	std::vector<std::shared_ptr<Property>> properties_;
 
-	friend BinarySerializer& operator<<(BinarySerializer& serializer, ShaderEffect& shader_effect);
+	SERIALIZE_FIELDS(&ShaderEffect::name_, &ShaderEffect::passes_, &ShaderEffect::code_chunks_, &ShaderEffect::resource_lists_,
+		&ShaderEffect::render_states_, &ShaderEffect::properties_)
 
 	friend std::ostream& operator<<(std::ostream& os, const ShaderEffect& shader_effect);
 
@@ -70,7 +70,8 @@ ST_REF<Shader> ResourceManager::LoadShader(const ST_STRING& vertPath, const ST_S
 
 
 void ResourceManager::UnloadTexture(const ST_STRING& path) {
-	_textures.erase(path);
+	if (_textures.erase(path))
+		++_textureGeneration;
 }
 
 void ResourceManager::UnloadModel(const ST_STRING& path) {
@@ -34,6 +34,11 @@ public:
 
 	void UnloadTexture(const ST_STRING& path);
 
+	// Changes whenever a texture is unloaded, holders of resolved textures compare it to know when to look them up again.
+	inline uint32_t GetTextureGeneration() const {
+		return _textureGeneration;
+	}
+
 	void UnloadModel(const ST_STRING& path);
 
 	void UnloadShader(const ST_STRING& vertPath, const ST_STRING& fragPath);
@@ -41,6 +46,8 @@ public:
 private:
 	ST_MAP<ST_STRING, ST_REF<Texture2D>> _textures;
 
+	uint32_t _textureGeneration = 1;
+
 	ST_MAP<ST_STRING, ST_REF<Model>> _models;
 
 	ST_MAP<ST_STRING, ST_REF<Shader>> _shaders;
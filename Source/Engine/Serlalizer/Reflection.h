@@ -0,0 +1,262 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Declares the serialized members of a struct, in serialization order:
+//
+//     struct Pass
+//     {
+//         std::string name_;
+//         int render_state_ref_;
+//         SERIALIZE_FIELDS(&Pass::name_, &Pass::render_state_ref_)
+//     };
+//
+// BinarySerializer, HashValue, SerializedSize and Equals are all generated from this list. Types serialized by hand instead
+// provide their own HashValue and SerializedSize overloads next to their operator<<, found by argument dependent lookup.
+#define SERIALIZE_FIELDS(...) \
+	static constexpr auto SerializeFields() { return std::make_tuple(__VA_ARGS__); }
+
+namespace reflection
+{
+template <typename T, typename = void>
+struct HasFields : std::false_type
+{};
+
+template <typename T>
+struct HasFields<T, std::void_t<decltype(T::SerializeFields())>> : std::true_type
+{};
+
+template <typename T>
+constexpr bool kHasFields = HasFields<T>::value;
+
+// Types written as raw bytes. Enums are included, they share the layout of their underlying type.
+template <typename T>
+constexpr bool kIsBlittable = std::is_trivially_copyable_v<T> && !kHasFields<T>;
+
+template <typename T>
+constexpr bool kUnsupported = false;
+
+template <typename Fields, typename Func, size_t... I>
+constexpr void ForEachField(const Fields& fields, Func&& func, std::index_sequence<I...>)
+{
+	(func(std::get<I>(fields)), ...);
+}
+
+template <typename T, typename Func>
+constexpr void ForEachField(Func&& func)
+{
+	constexpr auto fields = T::SerializeFields();
+	ForEachField(fields, func, std::make_index_sequence<std::tuple_size_v<decltype(fields)>>{});
+}
+
+// Walks the declared fields of value. Runs of blittable fields that are adjacent in memory are merged and
+// reported once through on_block(data, size); every other field goes to on_field(field). Adjacency is checked on the
+// field addresses as the walk goes, a pointer comparison per field.
+template <typename T, typename BlockFunc, typename FieldFunc>
+void VisitFields(T& value, BlockFunc&& on_block, FieldFunc&& on_field)
+{
+	using Byte = std::conditional_t<std::is_const_v<T>, const char, char>;
+	Byte* block_begin = nullptr;
+	size_t block_size = 0;
+	ForEachField<std::remove_const_t<T>>([&](auto member)
+	{
+		auto& field = value.*member;
+		using FieldType = std::remove_reference_t<decltype(field)>;
+		Byte* field_data = reinterpret_cast<Byte*>(&field);
+		if constexpr (kIsBlittable<std::remove_const_t<FieldType>>)
+		{
+			if (block_begin && block_begin + block_size == field_data)
+			{
+				block_size += sizeof(FieldType);
+				return;
+			}
+			if (block_begin) { on_block(block_begin, block_size); }
+			block_begin = field_data;
+			block_size = sizeof(FieldType);
+		}
+		else
+		{
+			if (block_begin) { on_block(block_begin, block_size); }
+			block_begin = nullptr;
+			block_size = 0;
+			on_field(field);
+		}
+	});
+	if (block_begin) { on_block(block_begin, block_size); }
+}
+
+// FNV-1a.
+constexpr uint64_t kHashSeed = 0xcbf29ce484222325ull;
+constexpr uint64_t kHashPrime = 0x100000001b3ull;
+
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = kHashSeed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= kHashPrime;
+	}
+	return hash;
+}
+
+template <typename T>
+uint64_t HashValue(const T& value, uint64_t hash = kHashSeed);
+
+inline uint64_t HashValue(const std::string& value, uint64_t hash = kHashSeed);
+
+template <typename U>
+uint64_t HashValue(const std::vector<U>& value, uint64_t hash = kHashSeed);
+
+template <typename U>
+uint64_t HashValue(const std::shared_ptr<U>& value, uint64_t hash = kHashSeed);
+
+template <typename T>
+size_t SerializedSize(const T& value);
+
+template <typename T>
+bool Equals(const T& a, const T& b);
+
+inline bool Equals(const std::string& a, const std::string& b);
+
+template <typename U>
+bool Equals(const std::vector<U>& a, const std::vector<U>& b);
+
+template <typename U>
+bool Equals(const std::shared_ptr<U>& a, const std::shared_ptr<U>& b);
+
+inline size_t SerializedSize(const std::string& value);
+
+template <typename U>
+size_t SerializedSize(const std::vector<U>& value);
+
+template <typename U>
+size_t SerializedSize(const std::shared_ptr<U>& value);
+
+// Hash of the serialized content of value. Blittable types are hashed by their bytes and should be free of padding.
+template <typename T>
+uint64_t HashValue(const T& value, uint64_t hash)
+{
+	if constexpr (kIsBlittable<T>) { return HashBytes(&value, sizeof(T), hash); }
+	else if constexpr (kHasFields<T>)
+	{
+		VisitFields(value, [&](const char* data, size_t size) { hash = HashBytes(data, size, hash); },
+			[&](const auto& field) { hash = HashValue(field, hash); });
+		return hash;
+	}
+	else { static_assert(kUnsupported<T>, "Type not supported by reflection"); return hash; }
+}
+
+inline uint64_t HashValue(const std::string& value, uint64_t hash)
+{
+	const uint32_t size = static_cast<uint32_t>(value.size());
+	hash = HashBytes(&size, sizeof(size), hash);
+	return HashBytes(value.data(), value.size(), hash);
+}
+
+template <typename U>
+uint64_t HashValue(const std::vector<U>& value, uint64_t hash)
+{
+	const uint32_t size = static_cast<uint32_t>(value.size());
+	hash = HashBytes(&size, sizeof(size), hash);
+	if constexpr (kIsBlittable<U>) { return HashBytes(value.data(), value.size() * sizeof(U), hash); }
+	else
+	{
+		for (const auto& element : value) { hash = HashValue(element, hash); }
+		return hash;
+	}
+}
+
+template <typename U>
+uint64_t HashValue(const std::shared_ptr<U>& value, uint64_t hash)
+{
+	const bool is_null = value == nullptr;
+	hash = HashBytes(&is_null, sizeof(is_null), hash);
+	return is_null
+	       ? hash
+	       : HashValue(*value, hash);
+}
+
+// Number of bytes BinarySerializer writes for value.
+template <typename T>
+size_t SerializedSize(const T& value)
+{
+	if constexpr (kIsBlittable<T>) { return sizeof(T); }
+	else if constexpr (kHasFields<T>)
+	{
+		size_t size = 0;
+		VisitFields(value, [&](const char*, size_t block_size) { size += block_size; },
+			[&](const auto& field) { size += SerializedSize(field); });
+		return size;
+	}
+	else { static_assert(kUnsupported<T>, "Type not supported by reflection"); return 0; }
+}
+
+inline size_t SerializedSize(const std::string& value) { return sizeof(uint32_t) + value.size(); }
+
+template <typename U>
+size_t SerializedSize(const std::vector<U>& value)
+{
+	if constexpr (kIsBlittable<U>) { return sizeof(uint32_t) + value.size() * sizeof(U); }
+	else
+	{
+		size_t size = sizeof(uint32_t);
+		for (const auto& element : value) { size += SerializedSize(element); }
+		return size;
+	}
+}
+
+template <typename U>
+size_t SerializedSize(const std::shared_ptr<U>& value)
+{
+	return value
+	       ? sizeof(bool) + SerializedSize(*value)
+	       : sizeof(bool);
+}
+
+// Compares the serialized content of a and b, the exact check behind equal HashValues.
+template <typename T>
+bool Equals(const T& a, const T& b)
+{
+	if constexpr (kIsBlittable<T>) { return std::memcmp(&a, &b, sizeof(T)) == 0; }
+	else if constexpr (kHasFields<T>)
+	{
+		bool equal = true;
+		ForEachField<T>([&](auto member) { equal = equal && Equals(a.*member, b.*member); });
+		return equal;
+	}
+	else { static_assert(kUnsupported<T>, "Type not supported by reflection"); return false; }
+}
+
+inline bool Equals(const std::string& a, const std::string& b) { return a == b; }
+
+template <typename U>
+bool Equals(const std::vector<U>& a, const std::vector<U>& b)
+{
+	if (a.size() != b.size()) { return false; }
+	if constexpr (kIsBlittable<U>) { return a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(U)) == 0; }
+	else
+	{
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (!Equals(a[i], b[i])) { return false; }
+		}
+		return true;
+	}
+}
+
+template <typename U>
+bool Equals(const std::shared_ptr<U>& a, const std::shared_ptr<U>& b)
+{
+	if (!a || !b) { return a == b; }
+	return Equals(*a, *b);
+}
+}
@@ -1,17 +1,117 @@
 ﻿#include "Serializer.h"
 
-BinarySerializer::BinarySerializer(SerializerAction action, std::string file_path):
-	action_(action), stream_(), file_path_(std::move(file_path))
+#include <algorithm>
+
+#include "HFX/HFX.h"
+
+BinarySerializer::BinarySerializer(SerializerAction action, std::string file_path, SerializerMode mode, size_t async_buffer_size):
+	action_(action), mode_(mode), stream_(), file_path_(std::move(file_path)), async_buffer_size_(async_buffer_size)
 {
 	if (action_ == SerializerAction::kWrite) { stream_.open(file_path_, std::ios::out | std::ios::binary); }
 	else { stream_.open(file_path_, std::ios::in | std::ios::binary); }
 	if (!stream_.is_open()) { throw std::runtime_error("Failed to open file: " + file_path_); }
+
+	// Reads are served straight from the stream, only writes go through the I/O thread.
+	if (action_ == SerializerAction::kRead) { mode_ = SerializerMode::kSync; }
+	if (mode_ == SerializerMode::kAsync)
+	{
+		front_buffer_.reserve(async_buffer_size_);
+		back_buffer_.reserve(async_buffer_size_);
+		io_thread_ = std::thread(&BinarySerializer::IoThreadMain, this);
+	}
+}
+
+BinarySerializer::~BinarySerializer()
+{
+	if (mode_ == SerializerMode::kAsync)
+	{
+		try { Wait(); }
+		catch (const std::exception& e) { std::cout << e.what() << std::endl; }
+		{
+			std::lock_guard<std::mutex> lock(io_mutex_);
+			io_stop_ = true;
+		}
+		io_condition_.notify_all();
+		io_thread_.join();
+	}
+	stream_.close();
+}
+
+void BinarySerializer::Flush()
+{
+	if (mode_ == SerializerMode::kAsync && !front_buffer_.empty()) { SwapBuffers(); }
+}
+
+void BinarySerializer::Wait()
+{
+	if (mode_ == SerializerMode::kSync)
+	{
+		stream_.flush();
+		return;
+	}
+	Flush();
+	std::unique_lock<std::mutex> lock(io_mutex_);
+	io_condition_.wait(lock, [this] { return !back_buffer_pending_; });
+	if (!io_failed_) { stream_.flush(); }
+	if (io_failed_ || !stream_) { throw std::runtime_error("Failed to write file: " + file_path_); }
+}
+
+void BinarySerializer::WriteBytesAsync(const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		if (front_buffer_.size() == async_buffer_size_) { SwapBuffers(); }
+		const size_t chunk_size = std::min(size, async_buffer_size_ - front_buffer_.size());
+		front_buffer_.insert(front_buffer_.end(), data, data + chunk_size);
+		data += chunk_size;
+		size -= chunk_size;
+	}
 }
 
-BinarySerializer::~BinarySerializer() { stream_.close(); }
+void BinarySerializer::SwapBuffers()
+{
+	// The producer only stalls here, when the front buffer is full and the back buffer is still being written.
+	std::unique_lock<std::mutex> lock(io_mutex_);
+	io_condition_.wait(lock, [this] { return !back_buffer_pending_; });
+	std::swap(front_buffer_, back_buffer_);
+	front_buffer_.clear();
+	back_buffer_pending_ = true;
+	lock.unlock();
+	io_condition_.notify_all();
+}
+
+void BinarySerializer::IoThreadMain()
+{
+	std::unique_lock<std::mutex> lock(io_mutex_);
+	while (true)
+	{
+		io_condition_.wait(lock, [this] { return back_buffer_pending_ || io_stop_; });
+		if (!back_buffer_pending_) { return; }
+
+		// back_buffer_ is owned by this thread until back_buffer_pending_ is cleared.
+		lock.unlock();
+		stream_.write(back_buffer_.data(), static_cast<std::streamsize>(back_buffer_.size()));
+		const bool failed = !stream_;
+		lock.lock();
+
+		io_failed_ = io_failed_ || failed;
+		back_buffer_pending_ = false;
+		io_condition_.notify_all();
+	}
+}
 
 #define EXPECT_EQ(a, b) if ((a) != (b)) { std::cout << "Expected: " << a << " Got: " << b << std::endl; }
 
+struct TestRecord
+{
+	std::string name_;
+	int id_;
+	float weight_;
+	std::vector<uint32_t> values_;
+
+	SERIALIZE_FIELDS(&TestRecord::name_, &TestRecord::id_, &TestRecord::weight_, &TestRecord::values_)
+};
+
 void TestSerializer()
 {
 	std::cout << "Starting Serializer Test" << std::endl;
@@ -38,5 +138,67 @@ void TestSerializer()
 	EXPECT_EQ(wi, ri)
 	EXPECT_EQ(wf, rf)
 	EXPECT_EQ(ws, rs)
+
+	TestRecord write_record{"Record", 7, 0.5f, {1, 2, 3}};
+	{
+		BinarySerializer serializer(SerializerAction::kWrite, "test.bin");
+		serializer << write_record;
+	}
+	TestRecord read_record;
+	{
+		BinarySerializer serializer(SerializerAction::kRead, "test.bin");
+		serializer << read_record;
+	}
+	std::ifstream written_file("test.bin", std::ios::binary | std::ios::ate);
+	EXPECT_EQ(reflection::SerializedSize(write_record), static_cast<size_t>(written_file.tellg()))
+	EXPECT_EQ(write_record.name_, read_record.name_)
+	EXPECT_EQ(write_record.id_, read_record.id_)
+	EXPECT_EQ(write_record.weight_, read_record.weight_)
+	EXPECT_EQ(write_record.values_.size(), read_record.values_.size())
+	EXPECT_EQ(reflection::HashValue(write_record), reflection::HashValue(read_record))
+
+	// Small buffers so the async path has to swap several times.
+	std::vector<TestRecord> write_records(1000, write_record);
+	{
+		BinarySerializer serializer(SerializerAction::kWrite, "test.bin", SerializerMode::kAsync, 64);
+		serializer << write_records;
+		serializer.Wait();
+	}
+	std::vector<TestRecord> read_records;
+	{
+		BinarySerializer serializer(SerializerAction::kRead, "test.bin");
+		serializer << read_records;
+	}
+	EXPECT_EQ(write_records.size(), read_records.size())
+	EXPECT_EQ(reflection::HashValue(write_records), reflection::HashValue(read_records))
+	EXPECT_EQ(reflection::Equals(write_records, read_records), true)
+
+	// Properties go through the hand-written dispatch, the reflected size and hash have to agree with it.
+	HFX::ShaderEffect write_effect;
+	write_effect.name_ = "Effect";
+	write_effect.passes_.push_back({"Main", {{graphics::ShaderType::kVertex, 0}}, {0}, 0, graphics::PassType::kGraphics});
+	write_effect.render_states_.push_back({"Opaque", {}, {}, {}});
+	auto float_property = std::make_shared<HFX::FloatProperty>();
+	float_property->name_ = "roughness";
+	float_property->type_ = graphics::PropertyType::kFloat;
+	float_property->default_value_ = 0.5f;
+	auto texture_property = std::make_shared<HFX::TextureProperty>();
+	texture_property->name_ = "albedo";
+	texture_property->type_ = graphics::PropertyType::kTexture2D;
+	texture_property->default_value_ = "White.jpg";
+	write_effect.properties_ = {float_property, texture_property};
+	{
+		BinarySerializer serializer(SerializerAction::kWrite, "test.bin");
+		serializer << write_effect;
+	}
+	HFX::ShaderEffect read_effect;
+	{
+		BinarySerializer serializer(SerializerAction::kRead, "test.bin");
+		serializer << read_effect;
+	}
+	std::ifstream effect_file("test.bin", std::ios::binary | std::ios::ate);
+	EXPECT_EQ(reflection::SerializedSize(write_effect), static_cast<size_t>(effect_file.tellg()))
+	EXPECT_EQ(write_effect.properties_.size(), read_effect.properties_.size())
+	EXPECT_EQ(reflection::HashValue(write_effect), reflection::HashValue(read_effect))
 	std::cout << "Serializer Test Finished" << std::endl;
 }
@@ -1,22 +1,42 @@
 ﻿#pragma once
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "Reflection.h"
+
 enum class SerializerAction
 {
 	kWrite,
 	kRead
 };
 
+enum class SerializerMode
+{
+	kSync,
+	// Writes are copied into a front buffer while a background thread flushes the back buffer to disk.
+	kAsync
+};
+
 class BinarySerializer
 {
 public:
-	BinarySerializer(SerializerAction action, std::string file_path);
+	static constexpr size_t kDefaultAsyncBufferSize = 4 * 1024 * 1024;
+
+	BinarySerializer(SerializerAction action, std::string file_path, SerializerMode mode = SerializerMode::kSync,
+		size_t async_buffer_size = kDefaultAsyncBufferSize);
 
 	~BinarySerializer();
 
+	BinarySerializer(const BinarySerializer&) = delete;
+
+	BinarySerializer& operator=(const BinarySerializer&) = delete;
+
 	template <typename T>
 	BinarySerializer& operator<<(T& value);
 
@@ -31,39 +51,72 @@ public:
 
 	SerializerAction GetAction() const { return action_; }
 
+	// Hands the front buffer to the I/O thread without waiting for it. No-op in sync mode.
+	void Flush();
+
+	// Flushes and blocks until every byte written so far has reached the file. Throws if the I/O thread failed.
+	void Wait();
+
 protected:
+	void SerializeBytes(void* data, size_t size)
+	{
+		if (action_ == SerializerAction::kWrite) { WriteBytes(data, size); }
+		else { ReadBytes(data, size); }
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		if (mode_ == SerializerMode::kSync) { stream_.write(static_cast<const char*>(data), size); }
+		else if (front_buffer_.size() + size <= async_buffer_size_)
+		{
+			const char* bytes = static_cast<const char*>(data);
+			front_buffer_.insert(front_buffer_.end(), bytes, bytes + size);
+		}
+		else { WriteBytesAsync(static_cast<const char*>(data), size); }
+	}
+
+	void ReadBytes(void* data, size_t size) { stream_.read(static_cast<char*>(data), size); }
+
+	void WriteBytesAsync(const char* data, size_t size);
+
+	void SwapBuffers();
+
+	void IoThreadMain();
+
 	SerializerAction action_;
+	SerializerMode mode_;
 	std::fstream stream_;
 	std::string file_path_;
+
+	// Async mode. front_buffer_ is only touched by the producer; back_buffer_ belongs to the I/O thread while
+	// back_buffer_pending_ is set.
+	size_t async_buffer_size_;
+	std::vector<char> front_buffer_;
+	std::vector<char> back_buffer_;
+	std::thread io_thread_;
+	std::mutex io_mutex_;
+	std::condition_variable io_condition_;
+	bool back_buffer_pending_ = false;
+	bool io_failed_ = false;
+	bool io_stop_ = false;
 };
 
 template <typename T>
 BinarySerializer& BinarySerializer::operator<<(T& value)
 {
-	if constexpr (std::is_enum<T>::value)
+	if constexpr (reflection::kHasFields<T>)
 	{
-		using UnderlyingType = std::underlying_type_t<T>;
-		UnderlyingType underlyingValue = static_cast<UnderlyingType>(value);
-		if (action_ == SerializerAction::kWrite)
-		{
-			const char* buffer = reinterpret_cast<char*>(&underlyingValue);
-			stream_.write(buffer, sizeof(UnderlyingType));
-		}
-		else
-		{
-			stream_.read(reinterpret_cast<char*>(&underlyingValue), sizeof(UnderlyingType));
-			value = static_cast<T>(underlyingValue);
-		}
+		reflection::VisitFields(value, [this](char* data, size_t size) { SerializeBytes(data, size); },
+			[this](auto& field) { *this << field; });
 	}
-	else if constexpr (std::is_trivial<T>::value)
+	else if constexpr (std::is_enum<T>::value)
 	{
-		if (action_ == SerializerAction::kWrite)
-		{
-			const char* buffer = reinterpret_cast<char*>(&value);
-			stream_.write(buffer, sizeof(T));
-		}
-		else { stream_.read(reinterpret_cast<char*>(&value), sizeof(T)); }
+		using UnderlyingType = std::underlying_type_t<T>;
+		UnderlyingType underlyingValue = static_cast<UnderlyingType>(value);
+		SerializeBytes(&underlyingValue, sizeof(UnderlyingType));
+		if (action_ == SerializerAction::kRead) { value = static_cast<T>(underlyingValue); }
 	}
+	else if constexpr (std::is_trivial<T>::value) { SerializeBytes(&value, sizeof(T)); }
 	else { throw std::runtime_error("Type not supported by BinarySerializer"); }
 	return *this;
 }
@@ -71,19 +124,12 @@ BinarySerializer& BinarySerializer::operator<<(T& value)
 template <typename U>
 BinarySerializer& BinarySerializer::operator<<(std::vector<U>& value)
 {
-	if (action_ == SerializerAction::kWrite)
-	{
-		uint32_t size = static_cast<uint32_t>(value.size());
-		stream_.write(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-		for (auto& element : value) { *this << element; }
-	}
-	else
-	{
-		uint32_t size = 0;
-		stream_.read(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-		value.resize(size);
-		for (auto& element : value) { *this << element; }
-	}
+	uint32_t size = static_cast<uint32_t>(value.size());
+	SerializeBytes(&size, sizeof(uint32_t));
+	if (action_ == SerializerAction::kRead) { value.resize(size); }
+	// Blittable elements are contiguous, so the whole array goes through in one copy.
+	if constexpr (reflection::kIsBlittable<U> && !std::is_same_v<U, bool>) { SerializeBytes(value.data(), value.size() * sizeof(U)); }
+	else { for (auto& element : value) { *this << element; } }
 	return *this;
 }
 
@@ -108,19 +154,10 @@ BinarySerializer& BinarySerializer::operator<<(std::shared_ptr<U>& value) {
 template <>
 BinarySerializer& BinarySerializer::operator<<(std::string& value)
 {
-	if (action_ == SerializerAction::kWrite)
-	{
-		uint32_t size = static_cast<uint32_t>(value.size());
-		stream_.write(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-		stream_.write(value.c_str(), size);
-	}
-	else
-	{
-		uint32_t size = 0;
-		stream_.read(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-		value.resize(size);
-		stream_.read(&value[0], size);
-	}
+	uint32_t size = static_cast<uint32_t>(value.size());
+	SerializeBytes(&size, sizeof(uint32_t));
+	if (action_ == SerializerAction::kRead) { value.resize(size); }
+	SerializeBytes(value.data(), size);
 	return *this;
 }
 